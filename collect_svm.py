@@ -24,12 +24,36 @@ nthreads = [1, 2, 4, 8, 16]
 algorithms = [
     "HogWild",
     "HogWild++",
-    "MyWild"
+    "MyWild",
+    # "HogWild++Async",  # cluster models synced by a background thread
+    # "MyWildAsync",
+    # "Hierarchical",  # replicas average through node models, node models over a ring
+    # "HierarchicalButterfly",
+    # "LocalSGD",  # private replicas averaged by an all-reduce every update_delay points
+    # "HogWildHot",  # HogWild with per-cluster pages for the most frequent features
+    # "HogWildInterleaved",  # HogWild model pages interleaved over the NUMA nodes
+    # "HogWildPartitioned",  # a contiguous, nnz-balanced feature range of the model per node
+    # "HogWildPartitionedReordered",  # the same after renumbering features by first occurrence
+]
+models = [
+    "svm",
+    # "logistic",
+    # "least_squares",
+    # "svm_ovr",  # one-vs-rest over all the labels in a single pass
 ]
 max_iterations = {
     "HogWild": {"default": 150, "epsilon": 75, "kdda": 20},
     "HogWild++": {"default": 50, "epsilon": 25, "kdda": 10},
     "MyWild": {"default": 50, "epsilon": 25, "kdda": 10},
+    "HogWild++Async": {"default": 50, "epsilon": 25, "kdda": 10},
+    "MyWildAsync": {"default": 50, "epsilon": 25, "kdda": 10},
+    "Hierarchical": {"default": 50, "epsilon": 25, "kdda": 10},
+    "HierarchicalButterfly": {"default": 50, "epsilon": 25, "kdda": 10},
+    "LocalSGD": {"default": 50, "epsilon": 25, "kdda": 10},
+    "HogWildHot": {"default": 150, "epsilon": 75, "kdda": 20},
+    "HogWildInterleaved": {"default": 150, "epsilon": 75, "kdda": 20},
+    "HogWildPartitioned": {"default": 150, "epsilon": 75, "kdda": 20},
+    "HogWildPartitionedReordered": {"default": 150, "epsilon": 75, "kdda": 20},
 }
 block_size = [2048]
 maxstepsize = {
@@ -68,14 +92,18 @@ stepdecay_per_dataset = {
 use_permutation = [False, True]
 
 
+# HogWild and its model placements train one shared model without clusters.
+shared_model_algorithms = ["HogWild", "HogWildInterleaved", "HogWildPartitioned", "HogWildPartitionedReordered"]
+
+
 def get_cluster_sizes(algorithm, threads):
-    if algorithm == "HogWild":
+    if algorithm in shared_model_algorithms:
         return [threads]
     return [threads // x for x in [2, 4, 8] if threads // x >= 1]
 
 
 def generate_update_delays(algorithm, nweights):
-    if algorithm == "HogWild":
+    if algorithm in shared_model_algorithms:
         return [0]
     if nweights <= 4:
         update_delay = 64
@@ -106,7 +134,7 @@ def is_dry_run():
 
 def create_step_decay_trials(d, algorithm, c):
     stepdecay = get_step_decay(d)
-    if algorithm == "HogWild":
+    if algorithm in shared_model_algorithms:
         return [stepdecay]
     return [stepdecay ** (1 / c)]
     # return [stepdecay ** ((i + 1) / stepdecay_trials_length) for i in range(0, stepdecay_trials_length * 2, 2)]
@@ -120,7 +148,7 @@ def get_step_decay(d):
 
 
 def get_effective_epochs(a, c, e):
-    if a == "HogWild":
+    if a in shared_model_algorithms:
         return e
     effective_epochs = e * c
     effective_epochs = min(1000, effective_epochs)
@@ -149,17 +177,18 @@ if __name__ == "__main__":
                         accuracy = target_accuracy[d]
                         step_size = maxstepsize[d]
                         for step_decay in create_step_decay_trials(d, algorithm, clusters):
-                            for bs in block_size:
-                                for permute in use_permutation:
-                                    permutation = "permutations/{}/{}_{}.txt".format(d, clusters, phy_threads) if permute else "none"
-                                    if permute and not path.exists(permutation):
-                                        if len(use_permutation) > 1:
-                                            continue
-                                        permutation = "none"
-                                    input_file.write("{} {} {} {} {} {} {} {} {} {} {}\n".format(
-                                        algorithm, test_repeats, thread, cluster_size, epochs,
-                                        update_delay, accuracy, step_size, step_decay, bs, permutation
-                                    ))
+                            for model in models:
+                                for bs in block_size:
+                                    for permute in use_permutation:
+                                        permutation = "permutations/{}/{}_{}.txt".format(d, clusters, phy_threads) if permute else "none"
+                                        if permute and not path.exists(permutation):
+                                            if len(use_permutation) > 1:
+                                                continue
+                                            permutation = "none"
+                                        input_file.write("{} {} {} {} {} {} {} {} {} {} {} {}\n".format(
+                                            algorithm, test_repeats, thread, cluster_size, epochs,
+                                            update_delay, accuracy, step_size, step_decay, bs, permutation, model
+                                        ))
         input_file.write("exit\n")
         input_file.close()
         verbose = "-v" in sys.argv
@@ -0,0 +1,100 @@
+//
+// Created by Maksim.Zuev on 17.10.2026.
+//
+
+#ifndef PSGD_BACKGROUND_SYNC_H
+#define PSGD_BACKGROUND_SYNC_H
+
+#include "types.h"
+#include "cpu_config.h"
+#include "vectors.h"
+#include "spin_wait.h"
+#include <pthread.h>
+#include <atomic>
+#include <cstdint>
+
+typedef void(* sync_pass_t)(void*, fp_type);
+
+// Helper thread that repeats a model sync pass while the workers train.
+// The passes are paced by the workers: every one of them ticks once per `delay` of its updates and a pass
+// runs once there are as many new ticks as workers, the helper waits for them on a wait_word meanwhile.
+// It takes the first thread slot not used by the workers, which is a hyper-thread sibling
+// once all the physical cores are busy (see cpu_config::assign_thread_affinity),
+// and stays unpinned if the workers occupy every CPU.
+class background_sync {
+private:
+  const sync_pass_t pass;
+  void* const pass_args;
+  const uint workers;
+  pthread_t thread{};
+  std::atomic<bool> running{};
+  // Learning rate of the current epoch, published by the workers.
+  std::atomic<fp_type> step{};
+  // Ticks of the workers, alone in its cache line.
+  cache_padded<wait_word>* const ticks;
+  // Passes of the last run, read after stop.
+  uint64_t passes = 0;
+
+  void thread_loop() {
+      if (workers < config.get_cpus()) config.bind_to_cpu(workers);
+      uint last = ticks->value.value.load(std::memory_order_acquire);
+      while (true) {
+          const uint current = ticks->value.value.load(std::memory_order_acquire);
+          if (current - last < workers) {
+              if (!running.load(std::memory_order_acquire)) break;
+              ticks->value.wait(current);
+              continue;
+          }
+          last = current;
+          pass(pass_args, step.load(std::memory_order_relaxed));
+          passes++;
+      }
+  }
+
+  static void* thread_run(void* data) {
+#ifdef __linux__
+      pthread_setname_np(pthread_self(), "Sync");
+#endif
+      reinterpret_cast<background_sync*>(data)->thread_loop();
+      return nullptr;
+  }
+
+public:
+  background_sync(sync_pass_t pass, void* pass_args, uint workers)
+      : pass(pass), pass_args(pass_args), workers(workers), ticks(new cache_padded<wait_word>()) {}
+
+  ~background_sync() {
+      stop();
+      delete ticks;
+  }
+
+  void start(const fp_type initial_step) {
+      if (running.load()) return;
+      step.store(initial_step);
+      passes = 0;
+      running.store(true);
+      pthread_create(&thread, nullptr, background_sync::thread_run, reinterpret_cast<void*>(this));
+  }
+
+  inline void set_step(const fp_type current_step) {
+      step.store(current_step, std::memory_order_relaxed);
+  }
+
+  // Called by a worker once per `delay` of its updates.
+  inline void tick() {
+      ticks->value.add(1);
+  }
+
+  void stop() {
+      if (!running.load()) return;
+      running.store(false, std::memory_order_release);
+      ticks->value.add(1);
+      pthread_join(thread, nullptr);
+  }
+
+  uint64_t get_passes() const {
+      return passes;
+  }
+};
+
+#endif //PSGD_BACKGROUND_SYNC_H
@@ -0,0 +1,579 @@
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <sys/stat.h>
+#include <thread>
+#include "model.h"
+#include "spin_barrier.h"
+#include "tree_barrier.h"
+#include "barrier_t.h"
+#include "thread_pool.h"
+
+typedef std::chrono::high_resolution_clock Time;
+typedef std::chrono::duration<double> fp_sec;
+
+static double file_megabytes(const std::string& name) {
+    struct stat st{};
+    if (stat(name.c_str(), &st) != 0) {
+        std::cerr << "Failed to open " << name << std::endl;
+        exit(1);
+    }
+    return st.st_size / (1024.0 * 1024.0);
+}
+
+static bool same_points(const dataset_local& a, const dataset_local& b) {
+    if (a.get_size() != b.get_size() || a.get_features() != b.get_features()) return false;
+    std::vector<uint> indices;
+    FOR_N(i, a.get_size()) {
+        // A point may be valid only until the next one is read, see vbyte_layout.
+        const data_point x = a[i];
+        indices.assign(x.indices, x.indices + x.size);
+        const data_point y = b[i];
+        if (x.size != y.size || x.label != y.label) return false;
+        FOR_N(j, x.size) {
+            if (indices[j] != y.indices[j] || feature_traits::get(x.data, j) != feature_traits::get(y.data, j)) return false;
+        }
+    }
+    return true;
+}
+
+// Compares the stringstream based loader with the parallel parser.
+static void benchmark_parse(const std::string& name, uint repeats) {
+    const double mb = file_megabytes(name);
+    double stream_time = 0, parallel_time = 0;
+    FOR_N(r, repeats) {
+        auto start = Time::now();
+        {
+            auto points = load_dataset_from_file(name);
+            dataset_local d(points.size(), points.data(), false);
+        }
+        auto middle = Time::now();
+        {
+            dataset_local d(name, false, false);
+        }
+        auto end = Time::now();
+        stream_time += static_cast<fp_sec>(middle - start).count();
+        parallel_time += static_cast<fp_sec>(end - middle).count();
+    }
+    stream_time /= repeats;
+    parallel_time /= repeats;
+
+    auto points = load_dataset_from_file(name);
+    const bool equal = same_points(dataset_local(points.size(), points.data(), false), dataset_local(name, false, false));
+
+    std::cout << "parse " << name << " size=" << mb << "MB"
+              << " stream=" << mb / stream_time << "MB/s"
+              << " parallel=" << mb / parallel_time << "MB/s"
+              << " speedup=" << stream_time / parallel_time
+              << " equal=" << (equal ? "yes" : "NO")
+              << std::endl;
+}
+
+// Runs dot + scale_and_add (the hinge update) over every point of the dataset `repeats` times.
+template<typename Dot, typename Axpy>
+static double time_kernels(const dataset_local& data, fp_type* w, uint repeats, Dot dot, Axpy axpy, fp_type& checksum) {
+    const uint size = data.get_size();
+    auto start = Time::now();
+    FOR_N(r, repeats) {
+        data.for_each(0, size, [&](const data_point& point) {
+            const fp_type label = binary_label(point.label);
+            const fp_type wxy = dot(w, point) * label;
+            if (wxy < 1) axpy(w, point, 1e-3 * label);
+        });
+    }
+    auto end = Time::now();
+    checksum = 0;
+    FOR_N(i, data.get_features()) {
+        checksum += w[i];
+    }
+    return static_cast<fp_sec>(end - start).count();
+}
+
+// Compares the scalar sparse kernels with the AVX2 and AVX-512 ones.
+static void benchmark_kernels(const std::string& name, uint repeats) {
+    const dataset_local data(name);
+    const uint features = data.get_features();
+    const double updates = static_cast<double>(data.get_size()) * repeats;
+    vector<fp_type> w;
+    w.init(features, 0);
+
+    fp_type checksum;
+    auto run = [&](const char* kernel, double time) {
+        std::cout << "kernels " << kernel << " " << updates / time / 1e6 << "M updates/s"
+                  << " checksum=" << checksum << std::endl;
+    };
+    std::fill(w.data, w.data + features, 0);
+    run("scalar", time_kernels(data, w.data, repeats, [](const fp_type* a, const data_point& p) {
+      return vectors::dot_scalar(a, p.indices, p.data, p.size);
+    }, [](fp_type* a, const data_point& p, fp_type s) {
+      vectors::scale_and_add_scalar(a, p.indices, p.data, p.size, s);
+    }, checksum));
+#ifdef PSGD_SIMD
+    if (simd::active >= simd::AVX2) {
+        std::fill(w.data, w.data + features, 0);
+        run("avx2", time_kernels(data, w.data, repeats, [](const fp_type* a, const data_point& p) {
+          return p.size >= 4 ? simd::dot_avx2(a, p.indices, p.data, p.size) : vectors::dot_scalar(a, p.indices, p.data, p.size);
+        }, [](fp_type* a, const data_point& p, fp_type s) {
+          if (p.size >= 4) simd::scale_and_add_avx2(a, p.indices, p.data, p.size, s);
+          else vectors::scale_and_add_scalar(a, p.indices, p.data, p.size, s);
+        }, checksum));
+    }
+    if (simd::active >= simd::AVX512) {
+        std::fill(w.data, w.data + features, 0);
+        run("avx512", time_kernels(data, w.data, repeats, [](const fp_type* a, const data_point& p) {
+          return p.size >= 8 ? simd::dot_avx512(a, p.indices, p.data, p.size) : vectors::dot_scalar(a, p.indices, p.data, p.size);
+        }, [](fp_type* a, const data_point& p, fp_type s) {
+          if (p.size >= 8) simd::scale_and_add_avx512(a, p.indices, p.data, p.size, s);
+          else vectors::scale_and_add_scalar(a, p.indices, p.data, p.size, s);
+        }, checksum));
+    }
+#endif
+}
+
+// Runs the SVM update over every point of the dataset `repeats` times, w is reset first.
+template<typename Update>
+static double time_update(const dataset_local& data, vector<fp_type>& w, uint repeats, Update update) {
+    const uint size = data.get_size();
+    std::fill(w.data, w.data + w.size, 0);
+    auto start = Time::now();
+    FOR_N(r, repeats) {
+        data.for_each(0, size, [&](const data_point& point) {
+            update(point, w.data);
+        });
+    }
+    auto end = Time::now();
+    return static_cast<fp_sec>(end - start).count();
+}
+
+// Compares the three pass SVM update (dot, hinge axpy, division by degree) with the fused one.
+static void benchmark_update(const std::string& name, uint repeats) {
+    const dataset_local data(name);
+    const uint features = data.get_features();
+    const uint size = data.get_size();
+    const double updates = static_cast<double>(size) * repeats;
+    const fp_type step = 1e-3;
+    const fp_type mu = 1;
+
+    vector<uint> degrees;
+    degrees.init(features, 0);
+    data.for_each(0, size, [&](const data_point& point) {
+        FOR_N(i, point.size) {
+            degrees[point.indices[i]]++;
+        }
+    });
+    vector<fp_type> mu_over_degree;
+    mu_over_degree.init(features, 0);
+    FOR_N(j, features) {
+        if (degrees[j] != 0) mu_over_degree[j] = mu / degrees[j];
+    }
+
+    vector<fp_type> reference;
+    reference.init(features, 0);
+    const double reference_time = time_update(data, reference, repeats, [&](const data_point& point, fp_type* vals) {
+      const fp_type label = binary_label(point.label);
+      const fp_type wxy = vectors::dot_scalar(vals, point.indices, point.data, point.size) * label;
+      if (wxy < 1) {
+          vectors::scale_and_add_scalar(vals, point.indices, point.data, point.size, step * label);
+      }
+      const fp_type scalar = step * mu;
+      FOR_N(i, point.size) {
+          const uint j = point.indices[i];
+          vals[j] *= 1 - scalar / degrees[j];
+      }
+    });
+    std::cout << "update three-pass " << updates / reference_time / 1e6 << "M updates/s" << std::endl;
+
+    vector<fp_type> w;
+    w.init(features, 0);
+    auto run = [&](const char* kernel, double time) {
+        fp_type max_diff = 0;
+        fp_type max_abs = 0;
+        FOR_N(j, features) {
+            max_diff = std::max(max_diff, std::abs(w[j] - reference[j]));
+            max_abs = std::max(max_abs, std::abs(reference[j]));
+        }
+        std::cout << "update " << kernel << " " << updates / time / 1e6 << "M updates/s"
+                  << " speedup=" << reference_time / time
+                  << " max_diff=" << max_diff << " max_abs=" << max_abs << std::endl;
+    };
+    run("fused-scalar", time_update(data, w, repeats, [&](const data_point& point, fp_type* vals) {
+      const fp_type label = binary_label(point.label);
+      const fp_type wxy = vectors::dot_scalar(vals, point.indices, point.data, point.size) * label;
+      const fp_type e = wxy < 1 ? step * label : 0;
+      vectors::scale_add_shrink_scalar(vals, point.indices, point.data, point.size, e, mu_over_degree.data, step);
+    }));
+    run((std::string("fused-") + simd::level_name(simd::active)).c_str(), time_update(data, w, repeats, [&](const data_point& point, fp_type* vals) {
+      const fp_type label = binary_label(point.label);
+      const fp_type wxy = vectors::dot(vals, point) * label;
+      const fp_type e = wxy < 1 ? step * label : 0;
+      vectors::scale_add_shrink(vals, point, e, mu_over_degree.data, step);
+    }));
+
+    // Lazy uniform decay optimizes the same objective in expectation, so only the speed is comparable.
+    const fp_type lambda = mu / size;
+    fp_type scale = 1;
+    const double lazy_time = time_update(data, w, repeats, [&](const data_point& point, fp_type* vals) {
+      const fp_type label = binary_label(point.label);
+      const fp_type wxy = vectors::dot(vals, point) * scale * label;
+      if (wxy < 1) vectors::scale_and_add(vals, point, step * label / scale);
+      scale *= 1 - step * lambda;
+    });
+    std::cout << "update lazy-" << simd::level_name(simd::active) << " " << updates / lazy_time / 1e6 << "M updates/s"
+              << " speedup=" << reference_time / lazy_time << std::endl;
+}
+
+// Compares K one-vs-rest binary passes over the dataset with one pass of the multi-output model
+// over a row-major features x K matrix. K is the range of the integer labels.
+static void benchmark_multiclass(const std::string& name, uint repeats) {
+    const dataset_local data(name);
+    const uint features = data.get_features();
+    const uint size = data.get_size();
+    const fp_type step = 1e-3;
+    const fp_type mu = 1;
+
+    int first_label = static_cast<int>(data[0].label);
+    int last_label = first_label;
+    vector<uint> degrees;
+    degrees.init(features, 0);
+    data.for_each(0, size, [&](const data_point& point) {
+        first_label = std::min(first_label, static_cast<int>(point.label));
+        last_label = std::max(last_label, static_cast<int>(point.label));
+        FOR_N(i, point.size) {
+            degrees[point.indices[i]]++;
+        }
+    });
+    const uint K = last_label - first_label + 1;
+    const double updates = static_cast<double>(size) * repeats * K;
+    vector<fp_type> mu_over_degree;
+    mu_over_degree.init(features, 0);
+    FOR_N(j, features) {
+        if (degrees[j] != 0) mu_over_degree[j] = mu / degrees[j];
+    }
+
+    vector<fp_type> w;
+    w.init(features, 0);
+    double binary_time = 0;
+    FOR_N(k, K) {
+        binary_time += time_update(data, w, repeats, [&](const data_point& point, fp_type* vals) {
+          const fp_type label = static_cast<int>(point.label) - first_label == static_cast<int>(k) ? 1 : -1;
+          const fp_type wxy = vectors::dot(vals, point) * label;
+          const fp_type e = wxy < 1 ? step * label : 0;
+          vectors::scale_add_shrink(vals, point, e, mu_over_degree.data, step);
+        });
+    }
+    std::cout << "multiclass K=" << K << " binary-passes " << updates / binary_time / 1e6 << "M point-outputs/s" << std::endl;
+
+    vector<fp_type> matrix;
+    matrix.init(features * K, 0);
+    std::vector<fp_type> e(K);
+    const double matrix_time = time_update(data, matrix, repeats, [&](const data_point& point, fp_type* vals) {
+      const int label_class = static_cast<int>(point.label) - first_label;
+      vectors::dot_rows(vals, point, K, e.data());
+      FOR_N(k, K) {
+          const fp_type label = label_class == static_cast<int>(k) ? 1 : -1;
+          e[k] = e[k] * label < 1 ? step * label : 0;
+      }
+      vectors::scale_add_shrink_rows(vals, point, K, e.data(), mu_over_degree.data, step);
+    });
+    std::cout << "multiclass K=" << K << " matrix-" << simd::level_name(simd::active) << " "
+              << updates / matrix_time / 1e6 << "M point-outputs/s"
+              << " speedup=" << binary_time / matrix_time << std::endl;
+}
+
+// Times `sync` on copies of the same random models and returns milliseconds per call.
+template<typename Sync>
+static double time_sync(const std::vector<fp_type>& cur, const std::vector<fp_type>& next, const std::vector<fp_type>& old,
+                        vector<fp_type>& cur_w, vector<fp_type>& next_w, vector<fp_type>& old_w, uint repeats, Sync sync) {
+    std::copy(cur.begin(), cur.end(), cur_w.data);
+    std::copy(next.begin(), next.end(), next_w.data);
+    std::copy(old.begin(), old.end(), old_w.data);
+    sync();
+    std::vector<fp_type> first(cur_w.data, cur_w.data + cur_w.size);
+    auto start = Time::now();
+    FOR_N(r, repeats) {
+        sync();
+    }
+    auto end = Time::now();
+    // Leave the result of a single sync for the comparison.
+    std::copy(first.begin(), first.end(), cur_w.data);
+    return static_cast<fp_sec>(end - start).count() * 1e3 / repeats;
+}
+
+// Compares the scalar HogWild++ and MyWild model sync with the SIMD and non-temporal store versions.
+static void benchmark_sync(uint features, uint repeats, fp_type touched) {
+    std::vector<fp_type> cur(features), next(features), old(features);
+    std::srand(42);
+    FOR_N(i, features) {
+        cur[i] = std::rand() / static_cast<fp_type>(RAND_MAX) - 0.5;
+        next[i] = std::rand() / static_cast<fp_type>(RAND_MAX) - 0.5;
+        old[i] = cur[i] + (std::rand() / static_cast<fp_type>(RAND_MAX) - 0.5) * 0.04;
+    }
+    vector<fp_type> cur_w, next_w, old_w;
+    cur_w.init(features);
+    next_w.init(features);
+    old_w.init(features);
+    std::vector<fp_type> reference;
+
+    hogwild_XX_params params(1, 1, 0.01, 1);
+    params.beta = 0.618;
+    params.lambda = 1 - params.beta;
+    const fp_type step = 0.5;
+    const std::string simd_name = simd::level_name(simd::active);
+
+    // The dirty-set sync only exchanges a part of the model, so it is not compared with the full one.
+    auto run = [&](const std::string& name, const uint streams, const double ms) {
+        fp_type max_diff = 0;
+        if (name.find("dirty") != std::string::npos) {
+            std::cout << "sync features=" << features << " " << name << " " << ms << "ms" << std::endl;
+            return;
+        }
+        if (reference.empty()) {
+            reference.assign(cur_w.data, cur_w.data + features);
+        } else {
+            FOR_N(i, features) {
+                max_diff = std::max(max_diff, std::abs(cur_w[i] - reference[i]));
+            }
+        }
+        const double bytes = static_cast<double>(streams) * sizeof(fp_type) * features;
+        std::cout << "sync features=" << features << " " << name << " " << ms << "ms "
+                  << bytes / ms / 1e6 << "GB/s max_diff=" << max_diff << std::endl;
+    };
+
+    // HogWild++ reads three vectors and writes cur and old (and next over the tolerance).
+    run("hogwild++-scalar", 5, time_sync(cur, next, old, cur_w, next_w, old_w, repeats, [&]() {
+      sync_hogwild_XX_scalar(cur_w.data, next_w.data, old_w.data, 0, features, step, params);
+    }));
+    run("hogwild++-" + simd_name, 5, time_sync(cur, next, old, cur_w, next_w, old_w, repeats, [&]() {
+      sync_hogwild_XX(cur_w.data, next_w.data, old_w.data, features, step, params);
+    }));
+
+    reference.clear();
+    run("mywild-scalar", 4, time_sync(cur, next, old, cur_w, next_w, old_w, repeats, [&]() {
+      sync_mywild_scalar(cur_w.data, next_w.data, 0, features);
+    }));
+    run("mywild-" + simd_name, 4, time_sync(cur, next, old, cur_w, next_w, old_w, repeats, [&]() {
+      sync_mywild(cur_w.data, next_w.data, features, false);
+    }));
+    run("mywild-" + simd_name + "-nt", 4, time_sync(cur, next, old, cur_w, next_w, old_w, repeats, [&]() {
+      sync_mywild(cur_w.data, next_w.data, features, true);
+    }));
+
+    // Dirty-set sync after a cluster touched `touched` of the features, marking is included in the time.
+    std::vector<uint> indices;
+    FOR_N(i, features) {
+        if (std::rand() < touched * RAND_MAX) indices.push_back(i);
+    }
+    const data_point point{static_cast<uint>(indices.size()), 1, indices.data(), nullptr};
+    dirty_set cur_dirty, next_dirty;
+    cur_dirty.init(features, 2);
+    next_dirty.init(features, 2);
+    const std::string dirty_name = "-dirty(" + std::to_string(touched) + ")";
+    run("hogwild++" + dirty_name, 5, time_sync(cur, next, old, cur_w, next_w, old_w, repeats, [&]() {
+      cur_dirty.mark(point);
+      cur_dirty.sync_with(next_dirty, features, [&](const uint start, const uint end) {
+        sync_hogwild_XX(cur_w.data + start, next_w.data + start, old_w.data + start, end - start, step, params);
+      });
+    }));
+    run("mywild" + dirty_name, 4, time_sync(cur, next, old, cur_w, next_w, old_w, repeats, [&]() {
+      cur_dirty.mark(point);
+      cur_dirty.sync_with(next_dirty, features, [&](const uint start, const uint end) {
+        sync_mywild(cur_w.data + start, next_w.data + start, end - start, false);
+      });
+    }));
+}
+
+// Random sparse read-modify-write of a model of `features` values, as in the update of a sparse point,
+// on every kind of pages. Reports the pages the model actually got.
+static void benchmark_pages(uint features, uint updates) {
+    std::vector<uint> indices(updates);
+    std::srand(42);
+    FOR_N(i, updates) {
+        indices[i] = static_cast<uint>((static_cast<uint64_t>(std::rand()) * RAND_MAX + std::rand()) % features);
+    }
+    const size_t bytes = static_cast<size_t>(features) * sizeof(fp_type);
+    const std::pair<huge_page_mode, const char*> modes[] = {
+        {no_huge_pages, "4k"},
+        {transparent_huge_pages, "thp"},
+        {hugetlb_2mb, "hugetlb-2mb"},
+        {hugetlb_1gb, "hugetlb-1gb"},
+    };
+    for (const auto& mode: modes) {
+        const uint64_t fallbacks = memory::get_counters().fallbacks;
+        auto* w = reinterpret_cast<fp_type*>(memory::allocate(bytes, -1, mode.first));
+        std::fill(w, w + features, 0.0);
+        const uint64_t hugetlb = memory::get_counters().hugetlb_bytes;
+        const uint64_t thp = memory::transparent_huge_bytes();
+        fp_type checksum = 0;
+        auto start = Time::now();
+        FOR_N(i, updates) {
+            const uint index = indices[i];
+            w[index] = w[index] * 0.999 + 1e-3;
+        }
+        auto end = Time::now();
+        FOR_N(i, features) {
+            checksum += w[i];
+        }
+        memory::release(w, bytes);
+        std::cout << "pages features=" << features << " " << mode.second
+                  << " " << static_cast<fp_sec>(end - start).count() * 1e9 / updates << "ns/update"
+                  << " hugetlb=" << (hugetlb >> 20) << "MB thp=" << (thp >> 20) << "MB"
+                  << " fallbacks=" << memory::get_counters().fallbacks - fallbacks
+                  << " checksum=" << checksum << std::endl;
+    }
+}
+
+// Nanoseconds per round of `rounds` barriers of `threads` threads bound as the pool binds them,
+// timed by thread 0 after a warm-up round. wait(thread_id) passes the barrier once.
+template<typename Wait>
+static double time_barrier(const uint threads, const uint rounds, Wait wait) {
+    double result = 0;
+    std::vector<std::thread> workers;
+    FOR_N(t, threads) {
+        workers.emplace_back([&, t]() {
+          config.bind_to_cpu(t);
+          wait(t);
+          const auto start = Time::now();
+          FOR_N(r, rounds) {
+              wait(t);
+          }
+          if (t == 0) result = static_cast<fp_sec>(Time::now() - start).count() * 1e9 / rounds;
+        });
+    }
+    for (std::thread& worker: workers) {
+        worker.join();
+    }
+    return result;
+}
+
+static void benchmark_barrier(uint max_threads, uint rounds) {
+    max_threads = std::min(max_threads, config.get_cpus());
+    std::vector<uint> counts;
+    for (uint threads = 1; threads < max_threads; threads *= 2) {
+        counts.push_back(threads);
+    }
+    counts.push_back(max_threads);
+    for (const uint threads: counts) {
+        spin_barrier spin(threads);
+        const double spin_time = time_barrier(threads, rounds, [&](uint) { spin.wait(); });
+        barrier_t pthread_barrier;
+        barrier_init(&pthread_barrier, nullptr, threads);
+        const double pthread_time = time_barrier(threads, rounds, [&](uint) { barrier_wait(&pthread_barrier); });
+        barrier_destroy(&pthread_barrier);
+        tree_barrier tree_spin(threads, SPIN_FOREVER);
+        const double tree_spin_time = time_barrier(threads, rounds, [&](uint t) { tree_spin.wait(t); });
+        tree_barrier tree(threads);
+        const double tree_time = time_barrier(threads, rounds, [&](uint t) { tree.wait(t); });
+        std::cout << "barrier threads=" << threads
+                  << " spin=" << spin_time << "ns"
+                  << " pthread=" << pthread_time << "ns"
+                  << " tree=" << tree_spin_time << "ns"
+                  << " tree+futex=" << tree_time << "ns" << std::endl;
+    }
+}
+
+// Nanoseconds per task of the thread pool, waiting for every task or submitting them all first,
+// against the dispatch through two pthread barriers with a heap-allocated result per thread.
+static void benchmark_dispatch(uint threads, uint tasks) {
+    threads = std::min(threads, config.get_cpus());
+    uint64_t checksum = 0;
+    double sync_time, async_time, barrier_time;
+    {
+        thread_pool tp(threads);
+        const auto task = [](const uint thread_id) { return thread_id + 1; };
+        tp.execute(task);
+        auto start = Time::now();
+        FOR_N(i, tasks) {
+            checksum += tp.execute(task).back();
+        }
+        sync_time = static_cast<fp_sec>(Time::now() - start).count() * 1e9 / tasks;
+        start = Time::now();
+        std::vector<std::future<std::vector<uint>>> futures;
+        futures.reserve(tasks);
+        FOR_N(i, tasks) {
+            futures.push_back(tp.submit(task));
+        }
+        for (std::future<std::vector<uint>>& future: futures) {
+            checksum += future.get().back();
+        }
+        async_time = static_cast<fp_sec>(Time::now() - start).count() * 1e9 / tasks;
+    }
+    {
+        barrier_t ready, finished;
+        barrier_init(&ready, nullptr, threads + 1);
+        barrier_init(&finished, nullptr, threads + 1);
+        std::atomic<bool> stop(false);
+        std::vector<uint*> results(threads);
+        std::vector<std::thread> workers;
+        FOR_N(t, threads) {
+            workers.emplace_back([&, t]() {
+              config.bind_to_cpu(t);
+              while (true) {
+                  barrier_wait(&ready);
+                  if (stop.load()) break;
+                  results[t] = new uint(t + 1);
+                  barrier_wait(&finished);
+              }
+            });
+        }
+        const auto start = Time::now();
+        FOR_N(i, tasks) {
+            barrier_wait(&ready);
+            barrier_wait(&finished);
+            checksum += *results.back();
+            for (uint* result: results) {
+                delete result;
+            }
+        }
+        barrier_time = static_cast<fp_sec>(Time::now() - start).count() * 1e9 / tasks;
+        stop.store(true);
+        barrier_wait(&ready);
+        for (std::thread& worker: workers) {
+            worker.join();
+        }
+        barrier_destroy(&ready);
+        barrier_destroy(&finished);
+    }
+    std::cout << "dispatch threads=" << threads
+              << " execute=" << sync_time << "ns"
+              << " submit=" << async_time << "ns"
+              << " pthread_barriers=" << barrier_time << "ns"
+              << " checksum=" << checksum << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage:\n"
+                  << "  benchmark parse <dataset path> [repeats]\n"
+                  << "  benchmark kernels <dataset path> [repeats]\n"
+                  << "  benchmark update <dataset path> [repeats]\n"
+                  << "  benchmark multiclass <dataset path> [repeats]\n"
+                  << "  benchmark sync <features> [repeats] [touched fraction]\n"
+                  << "  benchmark pages <features> [updates]\n"
+                  << "  benchmark barrier <max threads> [rounds]\n"
+                  << "  benchmark dispatch <threads> [tasks]\n"
+                  << std::endl;
+        exit(1);
+    }
+    const std::string what(argv[1]);
+    if (what == "parse") {
+        benchmark_parse(argv[2], argc > 3 ? std::atoi(argv[3]) : 3);
+    } else if (what == "kernels") {
+        benchmark_kernels(argv[2], argc > 3 ? std::atoi(argv[3]) : 10);
+    } else if (what == "update") {
+        benchmark_update(argv[2], argc > 3 ? std::atoi(argv[3]) : 10);
+    } else if (what == "multiclass") {
+        benchmark_multiclass(argv[2], argc > 3 ? std::atoi(argv[3]) : 3);
+    } else if (what == "sync") {
+        benchmark_sync(std::atoi(argv[2]), argc > 3 ? std::atoi(argv[3]) : 10, argc > 4 ? std::atof(argv[4]) : 0.001);
+    } else if (what == "pages") {
+        benchmark_pages(std::atoi(argv[2]), argc > 3 ? std::atoi(argv[3]) : 50000000);
+    } else if (what == "barrier") {
+        benchmark_barrier(std::atoi(argv[2]), argc > 3 ? std::atoi(argv[3]) : 100000);
+    } else if (what == "dispatch") {
+        benchmark_dispatch(std::atoi(argv[2]), argc > 3 ? std::atoi(argv[3]) : 100000);
+    } else {
+        std::cerr << "Unknown benchmark " << what << std::endl;
+        exit(1);
+    }
+    return 0;
+}
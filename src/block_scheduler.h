@@ -0,0 +1,98 @@
+//
+// Created by Maksim.Zuev on 17.10.2026.
+//
+
+#ifndef PSGD_BLOCK_SCHEDULER_H
+#define PSGD_BLOCK_SCHEDULER_H
+
+#include "types.h"
+#include "vectors.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Which threads may take the blocks of an epoch from another thread once they are done with their own.
+enum class steal_scope {
+  // Static schedule: every thread processes exactly its blocks.
+  none,
+  // Only the threads of the same cluster (of the cluster permutation), so the data of every cluster
+  // still trains its own replica.
+  cluster,
+  // The threads of the same node, e.g. for a sharded train set where the other nodes hold other points.
+  node,
+  // Any thread, the closest first: the same cluster, then the same node, then the other nodes.
+  any
+};
+
+// Blocks of one thread in an epoch. The owner takes them from the front, thieves from the back.
+// Both ends are packed into one word, so either end is taken with a single CAS.
+// Allocated by its owner, a deque starts at a cache line so that no two deques share one.
+struct alignas(64) block_deque : public cache_aligned {
+  std::atomic<uint64_t> range;
+  // Owner's block order and the first block of its range in this epoch, published before the range.
+  const uint* blocks;
+  std::atomic<uint> start_block;
+  char padding[64 - sizeof(std::atomic<uint64_t>) - sizeof(const uint*) - sizeof(std::atomic<uint>)];
+
+  block_deque() : range(0), blocks(nullptr), start_block(0) {}
+
+  static inline uint64_t pack(const uint head, const uint tail) {
+      return static_cast<uint64_t>(tail) << 32 | head;
+  }
+
+  // Must not overlap with the thieves of the previous epoch, the epoch barrier guarantees it.
+  void reset(const uint* order, const uint start, const uint count) {
+      blocks = order;
+      start_block.store(start, std::memory_order_relaxed);
+      range.store(pack(0, count), std::memory_order_release);
+  }
+
+  inline bool pop(uint& block) {
+      uint64_t current = range.load(std::memory_order_acquire);
+      while (true) {
+          const uint head = static_cast<uint>(current), tail = static_cast<uint>(current >> 32);
+          if (head >= tail) return false;
+          if (range.compare_exchange_weak(current, pack(head + 1, tail), std::memory_order_acq_rel)) {
+              block = blocks[head] + start_block.load(std::memory_order_relaxed);
+              return true;
+          }
+      }
+  }
+
+  inline bool steal(uint& block) {
+      uint64_t current = range.load(std::memory_order_acquire);
+      while (true) {
+          const uint head = static_cast<uint>(current), tail = static_cast<uint>(current >> 32);
+          if (head >= tail) return false;
+          if (range.compare_exchange_weak(current, pack(head, tail - 1), std::memory_order_acq_rel)) {
+              block = blocks[tail - 1] + start_block.load(std::memory_order_relaxed);
+              return true;
+          }
+      }
+  }
+};
+
+static_assert(sizeof(block_deque) == 64, "Block deques must take a cache line each.");
+
+// Victims of `thread_id` in the stealing order: the same cluster, then the same node, then the rest.
+// cluster_of and node_of map a thread to its cluster and node.
+template<typename ClusterOf, typename NodeOf>
+std::vector<uint> steal_order(const uint thread_id, const uint threads, const steal_scope scope, ClusterOf cluster_of, NodeOf node_of) {
+    std::vector<uint> result;
+    if (scope == steal_scope::none) return result;
+    const uint levels = scope == steal_scope::cluster ? 1 : scope == steal_scope::node ? 2 : 3;
+    FOR_N(level, levels) {
+        // Start right after the thread, so that the thieves of a victim are spread over its neighbours.
+        FOR_N(i, threads - 1) {
+            const uint victim = (thread_id + 1 + i) % threads;
+            const bool same_cluster = cluster_of(victim) == cluster_of(thread_id);
+            const bool same_node = node_of(victim) == node_of(thread_id);
+            if (scope == steal_scope::node && !same_node) continue;
+            const uint victim_level = same_cluster ? 0 : same_node ? 1 : 2;
+            if (victim_level == level) result.push_back(victim);
+        }
+    }
+    return result;
+}
+
+#endif //PSGD_BLOCK_SCHEDULER_H
@@ -7,6 +7,7 @@
 
 #include "numa.h"
 #include "types.h"
+#include "simd.h"
 #include <vector>
 #include <string>
 #include <sstream>
@@ -41,6 +42,10 @@ public:
       numa_free_cpumask(cpu_mask);
   }
 
+  unsigned get_cpus() const {
+      return cpus;
+  }
+
   unsigned get_numa_count() const {
       return nodes;
   }
@@ -100,6 +105,7 @@ private:
       std::cout << "CPUs: " << cpus << "\n";
       std::cout << "Phy cores: " << phy_cpus << "\n";
       std::cout << "Numa nodes:  " << nodes << "\n";
+      std::cout << "SIMD: " << simd::level_name(simd::active) << "\n";
       FOR_N(node, cpu_ids.size()) {
           std::cout << "Node " << node << ": ";
           FOR_N(i, cpu_ids[node].size()) {
@@ -7,7 +7,17 @@
 
 #include "vectors.h"
 #include "cpu_config.h"
+#include "simd.h"
+#include "dataset_layout.h"
+#include "background_sync.h"
+#include "tree_barrier.h"
+#include "spin_wait.h"
+#include "model_views.h"
 #include <cmath>
+#include <cstdint>
+#include <atomic>
+#include <new>
+#include <vector>
 
 // This is a reference interface for data scheme.
 // In order to avoid virtual cals we do not use this interface explicitly.
@@ -16,25 +26,77 @@
 // class abstract_data_scheme {
 //   virtual void* get_model_args(uint thread_id) = 0;
 //   virtual vector<fp_type>* get_model_vector(uint thread_id) = 0;
-//   virtual inline void post_update(uint thread_id, fp_type step) = 0;
+//   virtual inline void post_update(uint thread_id, fp_type step, const data_point& point) = 0;
+//   virtual void start_sync(fp_type step) = 0;
+//   // `points` is the number of points every thread processes at least in the epoch.
+//   virtual inline void start_epoch(uint thread_id, fp_type step, uint points) = 0;
+//   virtual void stop_sync() = 0;
 //   virtual abstract_data_scheme* clone() = 0;
 // };
 
+// Placement of the shared HogWild model across the NUMA nodes of the workers.
+enum class model_placement {
+  // Wherever the scheme is created.
+  local,
+  // Pages spread round-robin over the nodes.
+  interleaved,
+  // A contiguous feature range per node, see balanced_feature_ranges.
+  partitioned
+};
+
 class hogwild_data_scheme final {
 private:
   vector<fp_type>* const w;
   void* const args;
   const bool copy;
+  const model_placement placement;
 
-  hogwild_data_scheme(const hogwild_data_scheme& other) : w(other.w), args(other.args), copy(true) {}
+  hogwild_data_scheme(const hogwild_data_scheme& other) : w(other.w), args(other.args), copy(true), placement(other.placement) {}
 
 public:
-  hogwild_data_scheme(uint size, void* args) : w(new vector<fp_type>), args(args), copy(false) {
-      w->init(size, 0);
+  // `node_ends` are the ends of the model ranges of the nodes, the partitioned placement rounds them to pages.
+  hogwild_data_scheme(uint size, void* args, model_placement placement = model_placement::local,
+                      const std::vector<uint>& node_ends = std::vector<uint>())
+      : w(new vector<fp_type>), args(args), copy(false), placement(placement) {
+      if (placement == model_placement::local) {
+          w->init(size, 0);
+          return;
+      }
+      const size_t bytes = std::max<size_t>(size * sizeof(fp_type), 1);
+      const uint nodes = std::max<uint>(node_ends.size(), 1);
+      void* memory;
+      if (placement == model_placement::interleaved) {
+          struct bitmask* node_mask = numa_allocate_nodemask();
+          FOR_N(node, nodes) {
+              numa_bitmask_setbit(node_mask, node);
+          }
+          memory = numa_alloc_interleaved_subset(bytes, node_mask);
+          numa_free_nodemask(node_mask);
+      } else {
+          memory = numa_alloc(bytes);
+          if (memory != nullptr) {
+              const size_t page = numa_pagesize();
+              size_t start = 0;
+              FOR_N(node, nodes) {
+                  const size_t end = node + 1 == nodes ? bytes : std::min(bytes, (node_ends[node] * sizeof(fp_type) + page - 1) / page * page);
+                  if (end > start) numa_tonode_memory(reinterpret_cast<char*>(memory) + start, end - start, node);
+                  start = std::max(start, end);
+              }
+          }
+      }
+      if (memory == nullptr) throw std::bad_alloc();
+      // The first touch happens after the policy is set, so every page lands on its node.
+      w->size = size;
+      w->data = reinterpret_cast<fp_type*>(memory);
+      std::fill(w->data, w->data + size, 0.0);
   }
 
   ~hogwild_data_scheme() {
       if (copy) return;
+      if (placement != model_placement::local) {
+          numa_free(w->data, std::max<size_t>(w->size * sizeof(fp_type), 1));
+          w->data = NULL;
+      }
       delete w;
   }
 
@@ -47,7 +109,13 @@ public:
       return w;
   }
 
-  inline void post_update(uint, fp_type) {}
+  inline void post_update(uint, fp_type, const data_point&) {}
+
+  void start_sync(fp_type) {}
+
+  inline void start_epoch(uint, fp_type, uint) {}
+
+  void stop_sync() {}
 
   hogwild_data_scheme* clone() {
       return new hogwild_data_scheme(*this);
@@ -61,17 +129,20 @@ struct hogwild_XX_params {
   const uint phy_threads;
   const uint cluster_count;
   const uint delay;
+  // Sync on a background thread instead of the workers, it runs a pass once per delay updates of every worker.
+  const bool async;
 
   fp_type lambda;
   fp_type beta;
 
-  hogwild_XX_params(uint threads, uint cluster_size, fp_type tolerance, uint delay)
+  hogwild_XX_params(uint threads, uint cluster_size, fp_type tolerance, uint delay, bool async = false)
       : threads(threads),
         cluster_size(cluster_size),
         tolerance(tolerance),
         phy_threads(std::min(threads, config.get_phy_cpus())),
         cluster_count(phy_threads / cluster_size),
-        delay(delay * phy_threads) {
+        delay(delay * phy_threads),
+        async(async) {
       if ((phy_threads % cluster_size) != 0) throw std::runtime_error("Fractional clusters are not supported.");
       beta = SolveBeta(cluster_count);
       lambda = 1 - pow(beta, cluster_count - 1);
@@ -100,6 +171,118 @@ private:
   }
 };
 
+// Model features are grouped into chunks of 2^DIRTY_CHUNK_SHIFT, the ring sync schemes track the chunks
+// touched by every cluster and exchange only them, unless the build defines DENSE_SYNC.
+const uint DIRTY_CHUNK_SHIFT = 6;
+
+// Chunks changed by a cluster. A chunk keeps the number of ring hops its changes still have to travel:
+// training sets it to the number of clusters, a sync clears the own chunks and passes them on to the next
+// model with one hop less, so a change made by one cluster reaches all the others and then stops.
+// Marks are plain byte stores, a mark racing with a clear may delay a chunk until the next sync.
+// A mark reads the byte first and writes only a chunk that is not marked yet, so the threads of a cluster
+// hitting the same chunks share its lines instead of invalidating them with every update.
+class dirty_set {
+private:
+  vector<uint8_t> hops;
+  uint8_t max_hops = 0;
+
+public:
+  void init(const uint features, const uint clusters) {
+      hops.init((features >> DIRTY_CHUNK_SHIFT) + 1, 0);
+      max_hops = static_cast<uint8_t>(std::min(clusters, 255u));
+  }
+
+  inline void mark(const data_point& point) {
+      uint8_t* const __restrict__ data = hops.data;
+      const uint* const __restrict__ indices = point.indices;
+      FOR_N(i, point.size) {
+          const uint c = indices[i] >> DIRTY_CHUNK_SHIFT;
+          if (data[c] != max_hops) data[c] = max_hops;
+      }
+  }
+
+  // Calls f(start, end) for maximal feature ranges of chunks dirty in this or the next set.
+  template<typename F>
+  void sync_with(dirty_set& next, const uint features, F f) {
+      uint8_t* const own = hops.data;
+      uint8_t* const other = next.hops.data;
+      const uint chunks = hops.size;
+      uint c = 0;
+      while (c < chunks) {
+          if ((own[c] | other[c]) == 0) {
+              c++;
+              continue;
+          }
+          const uint start = c;
+          for (; c < chunks && (own[c] | other[c]) != 0; ++c) {
+              if (own[c] > 1 && own[c] - 1 > other[c]) other[c] = own[c] - 1;
+              own[c] = 0;
+          }
+          f(start << DIRTY_CHUNK_SHIFT, std::min(c << DIRTY_CHUNK_SHIFT, features));
+      }
+  }
+};
+
+// Number of leading elements to skip so that data + result is aligned to `alignment` bytes.
+static inline uint aligned_head(const fp_type* data, const uint size, const uint alignment) {
+    const uint misaligned = static_cast<uint>(reinterpret_cast<uintptr_t>(data) % alignment);
+    if (misaligned == 0) return 0;
+    return std::min(size, static_cast<uint>((alignment - misaligned) / sizeof(fp_type)));
+}
+
+// One HogWild++ sync step over [start, end).
+// The syncs work on the stored model vectors. Under the lazy regularisation the weights are these vectors
+// times the pending decay of a thread, which the syncs take equal for all the threads: the factors differ
+// by the decays of less than an epoch, and the epoch barrier folds them all into the vectors.
+static inline void sync_hogwild_XX_scalar(fp_type* const __restrict__ cur_w,
+                                          fp_type* const __restrict__ next_w,
+                                          fp_type* const __restrict__ old_ws,
+                                          const uint start,
+                                          const uint end,
+                                          const fp_type step,
+                                          const hogwild_XX_params& params) {
+    const fp_type beta = params.beta;
+    const fp_type lambda = params.lambda;
+    const fp_type tolerance = params.tolerance;
+
+    for (uint i = start; i < end; ++i) {
+        const fp_type wi = cur_w[i];
+        const fp_type delta = (wi - old_ws[i]) * step;
+        const fp_type next_i = next_w[i];
+        if (std::fabs(delta) > tolerance) {
+            const fp_type new_wi = next_i * lambda + wi * (1 - lambda) + (beta + lambda - 1) * delta;
+            next_w[i] = next_i + beta * delta;
+            cur_w[i] = new_wi;
+            old_ws[i] = new_wi;
+        } else {
+            const fp_type new_wi = next_i * lambda + wi * (1 - lambda) + lambda * delta;
+            cur_w[i] = new_wi;
+            old_ws[i] = new_wi - delta;
+        }
+    }
+}
+
+// Branch-free SIMD version of the loop above.
+static inline void sync_hogwild_XX(fp_type* const cur_w,
+                                   fp_type* const next_w,
+                                   fp_type* const old_ws,
+                                   const uint size,
+                                   const fp_type step,
+                                   const hogwild_XX_params& params) {
+    uint i = 0;
+#ifdef PSGD_SIMD
+    const fp_type beta = params.beta;
+    const fp_type lambda = params.lambda;
+    const fp_type tolerance = params.tolerance;
+    if (simd::active == simd::AVX512) {
+        i = simd::sync_hogwild_XX_avx512(cur_w, next_w, old_ws, i, size, step, beta, lambda, tolerance);
+    } else if (simd::active >= simd::AVX2) {
+        i = simd::sync_hogwild_XX_avx2(cur_w, next_w, old_ws, i, size, step, beta, lambda, tolerance);
+    }
+#endif
+    sync_hogwild_XX_scalar(cur_w, next_w, old_ws, i, size, step, params);
+}
+
 template<typename ModelParams>
 class hogwild_XX_data_scheme final {
 private:
@@ -109,7 +292,11 @@ private:
   vector<ModelParams*> model_params;
   vector<uint> thread_to_model;
   vector<int> next;
-  uint* sync_thread;
+  vector<dirty_set*> dirty;
+  uint outputs;
+  // Thread which syncs next, polled by every thread of the scheme and alone in its cache line.
+  cache_padded<uint>* sync_thread;
+  background_sync* helper;
   hogwild_XX_params params;
   int delay;
 
@@ -120,19 +307,24 @@ private:
         model_params(other.model_params),
         thread_to_model(other.thread_to_model),
         next(other.next),
+        dirty(other.dirty),
+        outputs(other.outputs),
         sync_thread(other.sync_thread),
+        helper(other.helper),
         params(other.params),
         delay(other.params.delay) {}
 
 public:
   hogwild_XX_data_scheme(uint size, ModelParams* args, const hogwild_XX_params& _params)
-      : copy(false), sync_thread(new uint(0)), params(_params) {
+      : copy(false), sync_thread(new cache_padded<uint>()), helper(nullptr), params(_params) {
       delay = params.delay;
 
       const uint cluster_count = params.cluster_count;
+      outputs = args->model_outputs();
       w.init(cluster_count);
       old_w.init(cluster_count);
       model_params.init(cluster_count);
+      dirty.init(cluster_count);
       FOR_N(cluster, cluster_count) {
           uint basic_thread_id = cluster * params.cluster_size;
           uint node = config.get_node_for_thread(basic_thread_id);
@@ -145,6 +337,9 @@ public:
               old_w[cluster]->init(size, 0.0);
 
               model_params[cluster] = new ModelParams(*args);
+
+              dirty[cluster] = new dirty_set;
+              dirty[cluster]->init(size / outputs, cluster_count);
           RUN_NUMA_END
       }
 
@@ -164,14 +359,17 @@ public:
                   next[thread_id] = (thread_id + 1) % params.cluster_size;
               }
           }
+          if (params.async) helper = new background_sync(sync_ring, this, params.threads);
       }
   }
 
   ~hogwild_XX_data_scheme() {
       if (copy) return;
       delete sync_thread;
+      delete helper;
       FOR_N(cluster, params.cluster_count) {
           delete model_params[cluster];
+          delete dirty[cluster];
           delete w[cluster];
           delete old_w[cluster];
       }
@@ -189,12 +387,39 @@ public:
       return new hogwild_XX_data_scheme(*this);
   }
 
-  inline void post_update(uint thread_id, const fp_type step) {
+  inline void post_update(uint thread_id, const fp_type step, const data_point& point) {
+#ifndef DENSE_SYNC
+      if (params.cluster_count > 1) dirty[thread_to_model[thread_id]]->mark(point);
+#else
+      (void) point;
+#endif
       if (likely(--delay > 0)) return;
-      if (thread_id != *sync_thread) return;
+      if (params.async) {
+          delay = params.delay;
+          if (helper) helper->tick();
+          return;
+      }
+      if (thread_id != sync_thread->value) return;
       sync_with_next(thread_id, step);
   }
 
+  void start_sync(const fp_type step) {
+      if (helper) helper->start(step);
+  }
+
+  inline void start_epoch(uint thread_id, const fp_type step, uint) {
+      if (helper && thread_id == 0) helper->set_step(step);
+  }
+
+  void stop_sync() {
+      if (helper) helper->stop();
+  }
+
+  // Background passes of the last run.
+  uint64_t sync_passes() const {
+      return helper ? helper->get_passes() : 0;
+  }
+
   void sync_with_next(uint thread_id, const fp_type step) {
       const int next_id = next[thread_id];
       if (next_id < 0) return;
@@ -204,34 +429,35 @@ public:
       if (model == next_model) {
           throw std::runtime_error("Next model equals current model.");
       }
+      sync_models(model, next_model, step);
 
-      const uint size = old_w[model]->size;
-      fp_type* const old_ws = old_w[model]->data;
-      fp_type* const cur_w = w[model]->data;
-      fp_type* const next_w = w[next_model]->data;
+      delay = params.delay;
+      sync_thread->value = next_id;
+  }
 
-      const fp_type beta = params.beta;
-      const fp_type lambda = params.lambda;
-      const fp_type tolerance = params.tolerance;
-
-      FOR_N(i, size) {
-          const fp_type wi = cur_w[i];
-          const fp_type delta = (wi - old_ws[i]) * step;
-          const fp_type next_i = next_w[i];
-          if (std::fabs(delta) > tolerance) {
-              const fp_type new_wi = next_i * lambda + wi * (1 - lambda) + (beta + lambda - 1) * delta;
-              next_w[i] = next_i + beta * delta;
-              cur_w[i] = new_wi;
-              old_ws[i] = new_wi;
-          } else {
-              const fp_type new_wi = next_i * lambda + wi * (1 - lambda) + lambda * delta;
-              cur_w[i] = new_wi;
-              old_ws[i] = new_wi - delta;
-          }
+private:
+  // One background pass: every model syncs with the next one around the ring.
+  static void sync_ring(void* scheme, const fp_type step) {
+      auto* self = reinterpret_cast<hogwild_XX_data_scheme<ModelParams>*>(scheme);
+      const uint clusters = self->params.cluster_count;
+      FOR_N(model, clusters) {
+          self->sync_models(model, (model + 1) % clusters, step);
       }
+  }
 
-      delay = params.delay;
-      *sync_thread = next_id;
+  void sync_models(const uint model, const uint next_model, const fp_type step) {
+      const uint size = old_w[model]->size;
+      fp_type* const cur_w = w[model]->data;
+      fp_type* const next_w = w[next_model]->data;
+      fp_type* const old_ws = old_w[model]->data;
+#ifdef DENSE_SYNC
+      sync_hogwild_XX(cur_w, next_w, old_ws, size, step, params);
+#else
+      const uint k = outputs;
+      dirty[model]->sync_with(*dirty[next_model], size / k, [&](const uint start, const uint end) {
+        sync_hogwild_XX(cur_w + start * k, next_w + start * k, old_ws + start * k, (end - start) * k, step, params);
+      });
+#endif
   }
 };
 
@@ -241,17 +467,62 @@ struct mywild_params {
   const uint phy_threads;
   const uint cluster_count;
   const uint delay;
+  // Sync on a background thread instead of the workers, it runs a pass once per delay updates of every worker.
+  const bool async;
 
-  mywild_params(uint threads, uint cluster_size, uint delay)
+  mywild_params(uint threads, uint cluster_size, uint delay, bool async = false)
       : threads(threads),
         cluster_size(cluster_size),
         phy_threads(std::min(threads, config.get_phy_cpus())),
         cluster_count(phy_threads / cluster_size),
-        delay(delay * phy_threads) {
+        delay(delay * phy_threads),
+        async(async) {
       if ((phy_threads % cluster_size) != 0) throw std::runtime_error("Fractional clusters are not supported.");
   }
 };
 
+// One MyWild sync step over [start, end): both models are replaced with their average.
+// The stored vectors are averaged, see sync_hogwild_XX_scalar for the lazy regularisation.
+static inline void sync_mywild_scalar(fp_type* const __restrict__ cur_w,
+                                      fp_type* const __restrict__ next_w,
+                                      const uint start,
+                                      const uint end) {
+    for (uint i = start; i < end; ++i) {
+        const fp_type wi = cur_w[i];
+        const fp_type next_i = next_w[i];
+        const fp_type new_wi = (wi + next_i) / 2;
+        cur_w[i] += new_wi - wi;
+        next_w[i] += new_wi - next_i;
+    }
+}
+
+// With `stream` the next model, which lives on another NUMA node, is written with non-temporal stores,
+// so its lines are not kept dirty in the local cache. Every lane of it is written, so none is lost.
+static inline void sync_mywild(fp_type* const cur_w,
+                               fp_type* const next_w,
+                               const uint size,
+                               const bool stream) {
+    uint i = 0;
+#ifdef PSGD_SIMD
+    if (simd::active >= simd::AVX2) {
+        const bool avx512 = simd::active == simd::AVX512;
+        if (stream) {
+            i = aligned_head(next_w, size, avx512 ? 64 : 32);
+            sync_mywild_scalar(cur_w, next_w, 0, i);
+            i = avx512 ? simd::sync_mywild_avx512<true>(cur_w, next_w, i, size)
+                       : simd::sync_mywild_avx2<true>(cur_w, next_w, i, size);
+            _mm_sfence();
+        } else {
+            i = avx512 ? simd::sync_mywild_avx512<false>(cur_w, next_w, i, size)
+                       : simd::sync_mywild_avx2<false>(cur_w, next_w, i, size);
+        }
+    }
+#else
+    (void) stream;
+#endif
+    sync_mywild_scalar(cur_w, next_w, i, size);
+}
+
 template<typename ModelParams>
 class mywild_data_scheme final {
 private:
@@ -260,7 +531,13 @@ private:
   vector<ModelParams*> model_params;
   vector<uint> thread_to_model;
   vector<int> next;
-  uint* sync_thread;
+  // Whether the next model of a thread is allocated on another NUMA node.
+  vector<bool> remote_next;
+  vector<dirty_set*> dirty;
+  uint outputs;
+  // Thread which syncs next, polled by every thread of the scheme and alone in its cache line.
+  cache_padded<uint>* sync_thread;
+  background_sync* helper;
   mywild_params params;
   int delay;
 
@@ -270,18 +547,24 @@ private:
         model_params(other.model_params),
         thread_to_model(other.thread_to_model),
         next(other.next),
+        remote_next(other.remote_next),
+        dirty(other.dirty),
+        outputs(other.outputs),
         sync_thread(other.sync_thread),
+        helper(other.helper),
         params(other.params),
         delay(other.params.delay) {}
 
 public:
   mywild_data_scheme(uint size, ModelParams* args, const mywild_params& _params)
-      : copy(false), sync_thread(new uint(0)), params(_params) {
+      : copy(false), sync_thread(new cache_padded<uint>()), helper(nullptr), params(_params) {
       delay = params.delay;
 
       const uint cluster_count = params.cluster_count;
+      outputs = args->model_outputs();
       w.init(cluster_count);
       model_params.init(cluster_count);
+      dirty.init(cluster_count);
       FOR_N(cluster, cluster_count) {
           uint basic_thread_id = cluster * params.cluster_size;
           uint node = config.get_node_for_thread(basic_thread_id);
@@ -291,6 +574,9 @@ public:
               w[cluster]->init(size, 0.0);
 
               model_params[cluster] = new ModelParams(*args);
+
+              dirty[cluster] = new dirty_set;
+              dirty[cluster]->init(size / outputs, cluster_count);
           RUN_NUMA_END
       }
 
@@ -301,6 +587,7 @@ public:
       }
 
       next.init(size, -1);
+      remote_next.init(size, false);
       if (params.cluster_count > 1) {
           FOR_N(thread_id, params.phy_threads) {
               const uint next_candidate = thread_id + params.cluster_size;
@@ -309,15 +596,19 @@ public:
               } else {
                   next[thread_id] = (thread_id + 1) % params.cluster_size;
               }
+              remote_next[thread_id] = config.get_node_for_thread(next[thread_id]) != config.get_node_for_thread(thread_id);
           }
+          if (params.async) helper = new background_sync(sync_ring, this, params.threads);
       }
   }
 
   ~mywild_data_scheme() {
       if (copy) return;
       delete sync_thread;
+      delete helper;
       FOR_N(cluster, params.cluster_count) {
           delete model_params[cluster];
+          delete dirty[cluster];
           delete w[cluster];
       }
   }
@@ -334,12 +625,37 @@ public:
       return new mywild_data_scheme(*this);
   }
 
-  inline void post_update(uint thread_id, const fp_type) {
+  inline void post_update(uint thread_id, const fp_type, const data_point& point) {
+#ifndef DENSE_SYNC
+      if (params.cluster_count > 1) dirty[thread_to_model[thread_id]]->mark(point);
+#else
+      (void) point;
+#endif
       if (likely(--delay > 0)) return;
-      if (thread_id != *sync_thread) return;
+      if (params.async) {
+          delay = params.delay;
+          if (helper) helper->tick();
+          return;
+      }
+      if (thread_id != sync_thread->value) return;
       sync_with_next(thread_id);
   }
 
+  void start_sync(const fp_type step) {
+      if (helper) helper->start(step);
+  }
+
+  inline void start_epoch(uint, fp_type, uint) {}
+
+  void stop_sync() {
+      if (helper) helper->stop();
+  }
+
+  // Background passes of the last run.
+  uint64_t sync_passes() const {
+      return helper ? helper->get_passes() : 0;
+  }
+
   void sync_with_next(uint thread_id) {
       const int next_id = next[thread_id];
       if (next_id < 0) return;
@@ -349,21 +665,598 @@ public:
       if (model == next_model) {
           throw std::runtime_error("Next model equals current model.");
       }
+      sync_models(model, next_model, remote_next[thread_id]);
 
+      delay = params.delay;
+      sync_thread->value = next_id;
+  }
+
+private:
+  // One background pass: every model syncs with the next one around the ring.
+  static void sync_ring(void* scheme, fp_type) {
+      auto* self = reinterpret_cast<mywild_data_scheme<ModelParams>*>(scheme);
+      const uint clusters = self->params.cluster_count;
+      FOR_N(model, clusters) {
+          self->sync_models(model, (model + 1) % clusters, self->remote_next[model * self->params.cluster_size]);
+      }
+  }
+
+  void sync_models(const uint model, const uint next_model, const bool stream) {
       const uint size = w[model]->size;
       fp_type* const cur_w = w[model]->data;
       fp_type* const next_w = w[next_model]->data;
+#ifdef DENSE_SYNC
+      sync_mywild(cur_w, next_w, size, stream);
+#else
+      const uint k = outputs;
+      dirty[model]->sync_with(*dirty[next_model], size / k, [&](const uint start, const uint end) {
+        sync_mywild(cur_w + start * k, next_w + start * k, (end - start) * k, stream);
+      });
+#endif
+  }
+};
+
+
+struct hierarchical_params {
+  const uint threads;
+  const uint cluster_size;
+  const uint phy_threads;
+  const uint cluster_count;
+  const uint delay;
+  // Number of replica syncs on a node between two exchanges of its node model.
+  const uint node_delay;
+  // Node models exchange with the node 2^round away instead of the next one on the ring.
+  const bool butterfly;
+
+  hierarchical_params(uint threads, uint cluster_size, uint delay, uint node_delay, bool butterfly)
+      : threads(threads),
+        cluster_size(cluster_size),
+        phy_threads(std::min(threads, config.get_phy_cpus())),
+        cluster_count(phy_threads / cluster_size),
+        delay(delay * phy_threads),
+        node_delay(node_delay),
+        butterfly(butterfly) {
+      if ((phy_threads % cluster_size) != 0) throw std::runtime_error("Fractional clusters are not supported.");
+      if (node_delay == 0) throw std::runtime_error("Node delay must be positive.");
+  }
+};
+
+// Sync state of a node, allocated on the node in a cache line of its own.
+struct alignas(64) hierarchical_node_state : public cache_aligned {
+  uint sync_thread;
+  uint syncs;
+  uint round;
+  char padding[64 - 3 * sizeof(uint)];
+};
+
+static_assert(sizeof(hierarchical_node_state) == 64, "Sync states of the nodes must take a cache line each.");
+
+// Two-level averaging. Every cluster trains its own replica as in MyWild, but a replica averages with
+// the model of its NUMA node, and every node_delay such syncs the node model averages with another
+// node model over a ring or a butterfly. Each node passes its own sync token between its threads,
+// so the nodes sync in parallel and only the node model exchange crosses sockets.
+template<typename ModelParams>
+class hierarchical_data_scheme final {
+private:
+  const bool copy;
+  vector<vector<fp_type>*> w;
+  vector<vector<fp_type>*> node_w;
+  vector<ModelParams*> model_params;
+  vector<hierarchical_node_state*> nodes;
+  vector<uint> thread_to_model;
+  vector<uint> thread_to_node;
+  // Next physical thread of the same node, the node sync token goes around them.
+  vector<uint> next_in_node;
+  uint node_count;
+  uint rounds;
+  hierarchical_params params;
+  int delay;
+
+  hierarchical_data_scheme(const hierarchical_data_scheme<ModelParams>& other)
+      : copy(true),
+        w(other.w),
+        node_w(other.node_w),
+        model_params(other.model_params),
+        nodes(other.nodes),
+        thread_to_model(other.thread_to_model),
+        thread_to_node(other.thread_to_node),
+        next_in_node(other.next_in_node),
+        node_count(other.node_count),
+        rounds(other.rounds),
+        params(other.params),
+        delay(other.params.delay) {}
+
+public:
+  hierarchical_data_scheme(uint size, ModelParams* args, const hierarchical_params& _params)
+      : copy(false), params(_params) {
+      delay = params.delay;
+
+      // Clusters are numbered node by node, a node (in the order of use) gets a dense index.
+      const uint cluster_count = params.cluster_count;
+      vector<uint> cluster_to_node;
+      vector<uint> node_ids;
+      cluster_to_node.init(cluster_count);
+      node_ids.init(cluster_count);
+      node_count = 0;
+      FOR_N(cluster, cluster_count) {
+          const uint node = config.get_node_for_thread(cluster * params.cluster_size);
+          if (node_count == 0 || node_ids[node_count - 1] != node) node_ids[node_count++] = node;
+          cluster_to_node[cluster] = node_count - 1;
+      }
+      rounds = 0;
+      while ((1u << rounds) < node_count) rounds++;
+
+      w.init(cluster_count);
+      model_params.init(cluster_count);
+      FOR_N(cluster, cluster_count) {
+          RUN_NUMA_START(node_ids[cluster_to_node[cluster]])
+              w[cluster] = new vector<fp_type>;
+              w[cluster]->init(size, 0.0);
 
-      FOR_N(i, size) {
-          const fp_type wi = cur_w[i];
-          const fp_type next_i = next_w[i];
-          const fp_type new_wi = (wi + next_i) / 2;
-          cur_w[i] += new_wi - wi;
-          next_w[i] += new_wi - next_i;
+              model_params[cluster] = new ModelParams(*args);
+          RUN_NUMA_END
+      }
+
+      node_w.init(node_count);
+      nodes.init(node_count);
+      FOR_N(node, node_count) {
+          RUN_NUMA_START(node_ids[node])
+              node_w[node] = new vector<fp_type>;
+              node_w[node]->init(size, 0.0);
+
+              nodes[node] = new hierarchical_node_state();
+          RUN_NUMA_END
+      }
+
+      thread_to_model.init(params.threads);
+      thread_to_node.init(params.threads);
+      FOR_N(thread_id, params.threads) {
+          uint model = (thread_id % params.phy_threads) / params.cluster_size;
+          thread_to_model[thread_id] = model;
+          thread_to_node[thread_id] = cluster_to_node[model];
+      }
+
+      // Physical threads of a node are consecutive, the token starts at the first one.
+      next_in_node.init(params.phy_threads);
+      FOR_N(thread_id, params.phy_threads) {
+          const uint node = thread_to_node[thread_id];
+          if (thread_id == 0 || thread_to_node[thread_id - 1] != node) nodes[node]->sync_thread = thread_id;
+          const uint next_thread = thread_id + 1;
+          next_in_node[thread_id] = next_thread < params.phy_threads && thread_to_node[next_thread] == node
+                                    ? next_thread : nodes[node]->sync_thread;
+      }
+  }
+
+  ~hierarchical_data_scheme() {
+      if (copy) return;
+      FOR_N(cluster, params.cluster_count) {
+          delete model_params[cluster];
+          delete w[cluster];
+      }
+      FOR_N(node, node_count) {
+          delete nodes[node];
+          delete node_w[node];
+      }
+  }
+
+  void* get_model_args(uint thread_id) {
+      return model_params[thread_to_model[thread_id]];
+  }
+
+  vector<fp_type>* get_model_vector(uint thread_id) {
+      return w[thread_to_model[thread_id]];
+  }
+
+  hierarchical_data_scheme<ModelParams>* clone() {
+      return new hierarchical_data_scheme(*this);
+  }
+
+  inline void post_update(uint thread_id, const fp_type, const data_point&) {
+      if (likely(--delay > 0)) return;
+      hierarchical_node_state* const state = nodes[thread_to_node[thread_id]];
+      if (thread_id != state->sync_thread) return;
+      sync_with_node(thread_id, state);
+  }
+
+  void start_sync(fp_type) {}
+
+  inline void start_epoch(uint, fp_type, uint) {}
+
+  void stop_sync() {}
+
+  void sync_with_node(uint thread_id, hierarchical_node_state* const state) {
+      if (params.cluster_count > 1) {
+          const uint model = thread_to_model[thread_id];
+          const uint node = thread_to_node[thread_id];
+          const uint size = w[model]->size;
+          sync_mywild(w[model]->data, node_w[node]->data, size, false);
+          if (++state->syncs >= params.node_delay) {
+              state->syncs = 0;
+              exchange_node_models(node, state);
+          }
       }
 
       delay = params.delay;
-      *sync_thread = next_id;
+      state->sync_thread = next_in_node[thread_id];
+  }
+
+private:
+  void exchange_node_models(const uint node, hierarchical_node_state* const state) {
+      if (node_count < 2) return;
+      uint other;
+      if (params.butterfly) {
+          other = node ^ (1u << state->round);
+          state->round = (state->round + 1) % rounds;
+          // Partners beyond the last node are skipped when the node count is not a power of two.
+          if (other >= node_count) return;
+      } else {
+          other = (node + 1) % node_count;
+      }
+      sync_mywild(node_w[node]->data, node_w[other]->data, node_w[node]->size, true);
+  }
+};
+
+
+struct local_sgd_params {
+  const uint threads;
+  const uint cluster_size;
+  const uint phy_threads;
+  const uint cluster_count;
+  // Points every thread processes between two averaging rounds.
+  const uint period;
+
+  local_sgd_params(uint threads, uint cluster_size, uint period)
+      : threads(threads),
+        cluster_size(cluster_size),
+        phy_threads(std::min(threads, config.get_phy_cpus())),
+        cluster_count(phy_threads / cluster_size),
+        period(period) {
+      if ((phy_threads % cluster_size) != 0) throw std::runtime_error("Fractional clusters are not supported.");
+      if (period == 0) throw std::runtime_error("Averaging period must be positive.");
+  }
+};
+
+// Features averaged at once by a thread, the block of every replica and the sum fit into L1.
+const uint LOCAL_SGD_BLOCK = 512;
+
+// Local SGD: every cluster trains a private replica, and every `period` points of each thread all the
+// replicas are replaced with their average. The averaging is an all-reduce spread over the pool threads:
+// after a barrier every thread averages its own slice of the features (reduce-scatter) and writes
+// the average back to all the replicas (all-gather), another barrier lets training continue.
+// The rounds per epoch are fixed at its start, so all the threads meet in every round.
+template<typename ModelParams>
+class local_sgd_data_scheme final {
+private:
+  const bool copy;
+  vector<vector<fp_type>*> w;
+  vector<ModelParams*> model_params;
+  vector<uint> thread_to_model;
+  tree_barrier* barrier;
+  local_sgd_params params;
+  vector<fp_type> sum;
+  int delay;
+  uint rounds_left;
+
+  local_sgd_data_scheme(const local_sgd_data_scheme<ModelParams>& other)
+      : copy(true),
+        w(other.w),
+        model_params(other.model_params),
+        thread_to_model(other.thread_to_model),
+        barrier(other.barrier),
+        params(other.params),
+        delay(other.params.period),
+        rounds_left(0) {
+      sum.init(LOCAL_SGD_BLOCK);
+  }
+
+public:
+  local_sgd_data_scheme(uint size, ModelParams* args, const local_sgd_params& _params)
+      : copy(false), barrier(new tree_barrier(_params.threads)), params(_params), delay(params.period), rounds_left(0) {
+      sum.init(LOCAL_SGD_BLOCK);
+
+      const uint cluster_count = params.cluster_count;
+      w.init(cluster_count);
+      model_params.init(cluster_count);
+      FOR_N(cluster, cluster_count) {
+          uint basic_thread_id = cluster * params.cluster_size;
+          uint node = config.get_node_for_thread(basic_thread_id);
+          RUN_NUMA_START(node)
+
+              w[cluster] = new vector<fp_type>;
+              w[cluster]->init(size, 0.0);
+
+              model_params[cluster] = new ModelParams(*args);
+          RUN_NUMA_END
+      }
+
+      thread_to_model.init(params.threads);
+      FOR_N(thread_id, params.threads) {
+          uint model = (thread_id % params.phy_threads) / params.cluster_size;
+          thread_to_model[thread_id] = model;
+      }
+  }
+
+  ~local_sgd_data_scheme() {
+      if (copy) return;
+      delete barrier;
+      FOR_N(cluster, params.cluster_count) {
+          delete model_params[cluster];
+          delete w[cluster];
+      }
+  }
+
+  void* get_model_args(uint thread_id) {
+      return model_params[thread_to_model[thread_id]];
+  }
+
+  vector<fp_type>* get_model_vector(uint thread_id) {
+      return w[thread_to_model[thread_id]];
+  }
+
+  local_sgd_data_scheme<ModelParams>* clone() {
+      return new local_sgd_data_scheme(*this);
+  }
+
+  inline void post_update(uint thread_id, fp_type, const data_point&) {
+      if (likely(--delay > 0)) return;
+      delay = params.period;
+      if (rounds_left == 0) return;
+      rounds_left--;
+      all_reduce(thread_id);
+  }
+
+  void start_sync(fp_type) {}
+
+  inline void start_epoch(uint, fp_type, const uint points) {
+      delay = params.period;
+      rounds_left = params.cluster_count > 1 ? points / params.period : 0;
+  }
+
+  // The replicas leave the run averaged, so that any of them is the final model.
+  void stop_sync() {
+      if (params.cluster_count > 1) average(0, w[0]->size);
+  }
+
+private:
+  void all_reduce(const uint thread_id) {
+      const uint size = w[0]->size;
+      const uint slice = (size + params.threads - 1) / params.threads;
+      const uint start = std::min(size, slice * thread_id);
+      const uint end = std::min(size, start + slice);
+      barrier->wait(thread_id);
+      average(start, end);
+      barrier->wait(thread_id);
+  }
+
+  // Replaces the replicas with their average over [start, end), block by block.
+  void average(const uint start, const uint end) {
+      const uint replicas = params.cluster_count;
+      const fp_type inv_replicas = fp_type(1) / replicas;
+      fp_type* const __restrict__ block_sum = sum.data;
+      for (uint block = start; block < end; block += LOCAL_SGD_BLOCK) {
+          const uint length = std::min(LOCAL_SGD_BLOCK, end - block);
+          std::fill(block_sum, block_sum + length, 0);
+          FOR_N(r, replicas) {
+              const fp_type* const __restrict__ replica = w[r]->data + block;
+              FOR_N(i, length) {
+                  block_sum[i] += replica[i];
+              }
+          }
+          FOR_N(r, replicas) {
+              fp_type* const __restrict__ replica = w[r]->data + block;
+              FOR_N(i, length) {
+                  replica[i] = block_sum[i] * inv_replicas;
+              }
+          }
+      }
+  }
+};
+
+
+#ifndef HOT_FEATURES
+#define HOT_FEATURES 256
+#endif
+
+struct hot_hogwild_params {
+  const uint threads;
+  const uint cluster_size;
+  const uint phy_threads;
+  const uint cluster_count;
+  // Points a cluster processes between two merges of its hot pages.
+  const uint period;
+  // Number of the most frequent features kept private.
+  const uint hot_features;
+
+  hot_hogwild_params(uint threads, uint cluster_size, uint period, uint hot_features = HOT_FEATURES)
+      : threads(threads),
+        cluster_size(cluster_size),
+        phy_threads(std::min(threads, config.get_phy_cpus())),
+        cluster_count(phy_threads / cluster_size),
+        period(period),
+        hot_features(hot_features) {
+      if ((phy_threads % cluster_size) != 0) throw std::runtime_error("Fractional clusters are not supported.");
+      if (period == 0) throw std::runtime_error("Merge period must be positive.");
+  }
+};
+
+// HogWild with the hottest features kept private. The features with the largest degrees are written
+// by almost every update, so their cache lines bounce between the cores of a shared model.
+// Every cluster gets a view of the model (see model_views) in which the pages holding these features
+// are its own. Privatisation works on whole pages, so the experiment renumbers the features first
+// (see hot_first_order): the hot ones fill the first pages and only they, with the few features sharing
+// their last page, are private, while the long tail stays shared. A streamed train set keeps its ids and
+// every page some hot feature falls on becomes private, which may cover most of a mid-sized model.
+// Every `period` points the first thread of a cluster merges the changes of its hot pages into
+// the shared copy and picks up the changes of the others.
+template<typename ModelParams>
+class hot_hogwild_data_scheme final {
+private:
+  const bool copy;
+  model_views* views;
+  vector<vector<fp_type>*> w;
+  // Private pages of every cluster as of its last merge.
+  vector<vector<fp_type>*> snapshots;
+  vector<spin_lock>* locks;
+  vector<uint> thread_to_model;
+  void* const args;
+  hot_hogwild_params params;
+  int delay;
+
+  hot_hogwild_data_scheme(const hot_hogwild_data_scheme<ModelParams>& other)
+      : copy(true),
+        views(other.views),
+        w(other.w),
+        snapshots(other.snapshots),
+        locks(other.locks),
+        thread_to_model(other.thread_to_model),
+        args(other.args),
+        params(other.params),
+        delay(other.params.period) {}
+
+  // Pages of the `hot` features with the largest degrees, in increasing order.
+  // Ties go to the smaller id, as in hot_first_order, so a renumbered model takes just its first pages.
+  static vector<uint> hot_pages(const ModelParams* args, const uint hot, const uint page_values) {
+      const vector<uint>& degrees = args->degrees;
+      const uint outputs = args->model_outputs();
+      std::vector<uint> features;
+      FOR_N(j, degrees.size) {
+          if (degrees[j] > 0) features.push_back(j);
+      }
+      const auto by_degree = [&](const uint a, const uint b) {
+        return degrees[a] > degrees[b] || (degrees[a] == degrees[b] && a < b);
+      };
+      if (features.size() > hot) {
+          std::nth_element(features.begin(), features.begin() + hot, features.end(), by_degree);
+          features.resize(hot);
+      }
+      std::vector<uint> pages;
+      for (const uint j: features) {
+          const uint first = static_cast<uint>(static_cast<uint64_t>(j) * outputs / page_values);
+          const uint last = static_cast<uint>((static_cast<uint64_t>(j) * outputs + outputs - 1) / page_values);
+          for (uint page = first; page <= last; ++page) pages.push_back(page);
+      }
+      std::sort(pages.begin(), pages.end());
+      pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+      vector<uint> result;
+      result.init(pages.size());
+      std::copy(pages.begin(), pages.end(), result.data);
+      return result;
+  }
+
+public:
+  hot_hogwild_data_scheme(uint size, ModelParams* args, const hot_hogwild_params& _params)
+      : copy(false), args(args), params(_params), delay(params.period) {
+      const uint cluster_count = params.cluster_count;
+      const uint page_values = static_cast<uint>(sysconf(_SC_PAGESIZE) / sizeof(fp_type));
+      // A single cluster has nobody to share the lines with.
+      const vector<uint> pages = cluster_count > 1 ? hot_pages(args, params.hot_features, page_values) : vector<uint>();
+      views = new model_views(size, cluster_count, pages);
+      const uint hot = views->private_count();
+
+      locks = new vector<spin_lock>;
+      locks->init(hot);
+      w.init(cluster_count);
+      snapshots.init(cluster_count);
+      FOR_N(cluster, cluster_count) {
+          uint basic_thread_id = cluster * params.cluster_size;
+          uint node = config.get_node_for_thread(basic_thread_id);
+          RUN_NUMA_START(node)
+              w[cluster] = new vector<fp_type>;
+              w[cluster]->size = size;
+              w[cluster]->data = views->view(cluster);
+
+              // The first touch places the private pages on the node of the cluster.
+              FOR_N(h, hot) {
+                  std::fill(views->private_page(cluster, h), views->private_page(cluster, h) + page_values, 0.0);
+              }
+              snapshots[cluster] = new vector<fp_type>;
+              snapshots[cluster]->init(hot * page_values, 0.0);
+          RUN_NUMA_END
+      }
+
+      thread_to_model.init(params.threads);
+      FOR_N(thread_id, params.threads) {
+          uint model = (thread_id % params.phy_threads) / params.cluster_size;
+          thread_to_model[thread_id] = model;
+      }
+  }
+
+  ~hot_hogwild_data_scheme() {
+      if (copy) return;
+      FOR_N(cluster, params.cluster_count) {
+          // The data belongs to the views.
+          w[cluster]->data = NULL;
+          delete w[cluster];
+          delete snapshots[cluster];
+      }
+      delete locks;
+      delete views;
+  }
+
+  void* get_model_args(uint) {
+      return args;
+  }
+
+  vector<fp_type>* get_model_vector(uint thread_id) {
+      return w[thread_to_model[thread_id]];
+  }
+
+  hot_hogwild_data_scheme<ModelParams>* clone() {
+      return new hot_hogwild_data_scheme(*this);
+  }
+
+  // Features on the private pages of a cluster: the hot ones and those sharing their pages.
+  uint private_features() const {
+      const uint64_t values = static_cast<uint64_t>(views->private_count()) * views->page_values();
+      return static_cast<uint>(std::min<uint64_t>(values, views->get_size()) / reinterpret_cast<const ModelParams*>(args)->model_outputs());
+  }
+
+  inline void post_update(uint thread_id, fp_type, const data_point&) {
+      if (likely(--delay > 0)) return;
+      delay = params.period;
+      if (thread_id < params.phy_threads && thread_id % params.cluster_size == 0) merge(thread_to_model[thread_id]);
+  }
+
+  void start_sync(fp_type) {}
+
+  inline void start_epoch(uint, fp_type, uint) {}
+
+  // All the views leave the run with the same hot pages.
+  void stop_sync() {
+      const uint hot = views->private_count();
+      const uint values = views->page_values();
+      FOR_N(cluster, params.cluster_count) {
+          merge(cluster);
+      }
+      FOR_N(cluster, params.cluster_count) {
+          FOR_N(h, hot) {
+              const fp_type* const master = views->master_page(h);
+              std::copy(master, master + values, views->private_page(cluster, h));
+              std::copy(master, master + values, snapshots[cluster]->data + h * values);
+          }
+      }
+  }
+
+private:
+  // Adds the changes of the cluster since its last merge to the shared pages and takes them back.
+  // Updates of the other threads of the cluster that race with the merge may be lost, as in HogWild.
+  void merge(const uint cluster) {
+      const uint hot = views->private_count();
+      const uint values = views->page_values();
+      FOR_N(h, hot) {
+          fp_type* const __restrict__ master = views->master_page(h);
+          fp_type* const __restrict__ own = views->private_page(cluster, h);
+          fp_type* const __restrict__ snapshot = snapshots[cluster]->data + h * values;
+          spin_lock& lock = (*locks)[h];
+          lock.lock();
+          FOR_N(i, values) {
+              const fp_type merged = master[i] + (own[i] - snapshot[i]);
+              master[i] = merged;
+              own[i] = merged;
+              snapshot[i] = merged;
+          }
+          lock.unlock();
+      }
   }
 };
 
@@ -7,52 +7,138 @@
 
 #include "numa.h"
 #include "dataset_local.h"
+#include <vector>
 
-class dataset {
+// Weight of every node in a sharded dataset, e.g. the number of its worker threads.
+struct shard_weights {
+  std::vector<uint> weights;
+};
+
+template<typename Layout>
+class basic_dataset {
 private:
-  vector<dataset_local*> datasets;
+  // A replica per node, or a shard per node for the sharded datasets.
+  // Shards only move between the nodes, so they may be replaced in a const dataset (see migrate).
+  mutable vector<basic_dataset_local<Layout>*> datasets;
+  // Before migrations node i keeps points [starts[i], starts[i + 1]) of source.
+  const basic_dataset_local<Layout>* source = nullptr;
+  std::vector<uint> starts;
 
 public:
-  dataset(uint nodes, const std::string& name) {
+  basic_dataset(uint nodes, const std::string& name) {
       datasets.init(nodes);
       FOR_N(i, nodes) {
           RUN_NUMA_START(i)
               if (i == 0) {
-                  datasets[0] = new dataset_local(name);
+                  datasets[0] = new basic_dataset_local<Layout>(name);
+              } else {
+                  datasets[i] = new basic_dataset_local<Layout>(*datasets[0]);
+              }
+          RUN_NUMA_END
+      }
+  }
+
+  basic_dataset(const basic_dataset& other, const std::vector<uint>& inverse_permutation) {
+      datasets.init(other.datasets.size);
+      FOR_N(i, datasets.size) {
+          RUN_NUMA_START(i)
+              if (i == 0) {
+                  datasets[0] = new basic_dataset_local<Layout>(*other.datasets[0], inverse_permutation);
               } else {
-                  datasets[i] = new dataset_local(*datasets[0]);
+                  datasets[i] = new basic_dataset_local<Layout>(*datasets[0]);
               }
           RUN_NUMA_END
       }
   }
 
-  dataset(const dataset& other, const std::vector<uint>& inverse_permutation) {
+  basic_dataset(const basic_dataset& other, const feature_renumbering& renumbering) {
       datasets.init(other.datasets.size);
       FOR_N(i, datasets.size) {
           RUN_NUMA_START(i)
               if (i == 0) {
-                  datasets[0] = new dataset_local(*other.datasets[0], inverse_permutation);
+                  datasets[0] = new basic_dataset_local<Layout>(*other.datasets[0], renumbering);
               } else {
-                  datasets[i] = new dataset_local(*datasets[0]);
+                  datasets[i] = new basic_dataset_local<Layout>(*datasets[0]);
               }
           RUN_NUMA_END
       }
   }
 
-  ~dataset() {
+  // Shards `other` between the nodes instead of replicating it, node i gets a part proportional to its weight.
+  // `other` must outlive the shards, they are rebuilt from it by migrate.
+  basic_dataset(const basic_dataset& other, const shard_weights& shards) : source(other.datasets[0]) {
+      const std::vector<uint>& weights = shards.weights;
+      assert(!other.is_sharded());
+      const uint size = other.get_size();
+      uint64_t total = 0;
+      for (const uint weight: weights) total += weight;
+      starts.assign(weights.size() + 1, 0);
+      uint64_t prefix = 0;
+      FOR_N(i, weights.size()) {
+          prefix += weights[i];
+          starts[i + 1] = prefix * size / total;
+      }
+      datasets.init(weights.size());
+      FOR_N(i, datasets.size) {
+          datasets[i] = nullptr;
+          RUN_NUMA_START(i)
+              migrate(i, 0);
+          RUN_NUMA_END
+      }
+  }
+
+  ~basic_dataset() {
       FOR_N(i, datasets.size) {
           delete datasets[i];
       }
   }
 
-  inline const dataset_local& get_data(uint node) const {
+  inline const basic_dataset_local<Layout>& get_data(uint node) const {
       return *datasets[node];
   }
 
   inline uint get_features() const {
       return datasets[0]->get_features();
   }
+
+  inline uint get_size() const {
+      return is_sharded() ? starts.back() : datasets[0]->get_size();
+  }
+
+  inline bool is_sharded() const {
+      return source != nullptr;
+  }
+
+  // Rebuilds the shard of `node` as it is after `migrations` migrations, every migration moves
+  // the points of node i - 1 to node i (exactly so when the nodes have equal weights).
+  // Must run on `node` while nobody reads its shard. The old shard is released first,
+  // the new one is copied from the source, so the shards never take more than one copy of the dataset.
+  void migrate(const uint node, const uint migrations) const {
+      assert(is_sharded());
+      uint used = 0;
+      FOR_N(i, datasets.size) {
+          if (starts[i + 1] > starts[i]) used++;
+      }
+      const uint size = get_size();
+      const uint shift = static_cast<uint>(static_cast<uint64_t>(size / std::max(1u, used)) * migrations % std::max(1u, size));
+      std::vector<uint> points(starts[node + 1] - starts[node]);
+      FOR_N(j, points.size()) {
+          points[j] = (starts[node] + j + size - shift) % size;
+      }
+      delete datasets[node];
+      datasets[node] = new basic_dataset_local<Layout>(*source, points);
+  }
+
+  // Calls f(point) for every point, the same scan is provided by dataset_stream.
+  template<typename F>
+  inline void for_each(F f) const {
+      const uint parts = is_sharded() ? datasets.size : 1;
+      FOR_N(i, parts) {
+          datasets[i]->for_each(0, datasets[i]->get_size(), f);
+      }
+  }
 };
 
+typedef basic_dataset<DATASET_LAYOUT> dataset;
 
 #endif //PSGD_DATASET_H
@@ -0,0 +1,349 @@
+//
+// Created by Maksim.Zuev on 17.10.2026.
+//
+
+#ifndef PSGD_DATASET_LAYOUT_H
+#define PSGD_DATASET_LAYOUT_H
+
+#include "types.h"
+#include "feature_value.h"
+#include "stream_vbyte.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+const uint SIZE_UINT = sizeof(uint);
+const uint SIZE_FP_TYPE = sizeof(fp_type);
+const uint SIZE_OFFSET = sizeof(uint64_t);
+const uint SIZE_FEATURE = feature_traits::SIZE;
+const uint CACHE_LINE_SIZE = 64;
+
+// Labels are stored as they are in the file.
+struct data_point {
+  uint size;
+  fp_type label;
+  const uint* indices;
+  const feature_type* data;
+};
+
+// Binary models treat label 1 as the positive class and any other label as the negative one.
+static inline fp_type binary_label(const fp_type label) {
+    return label == 1.0 ? 1.0 : -1.0;
+}
+
+// Writable view of a point which is being placed into a dataset buffer.
+struct point_writer {
+  fp_type* label;
+  uint* indices;
+  feature_type* data;
+};
+
+static inline uint64_t align_to_cache_line(uint64_t offset) {
+    return (offset + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+// This is a reference interface for dataset storage layout.
+// A layout describes how points are placed inside one contiguous buffer.
+// All the references inside the buffer are offsets, so the buffer can be copied or mmap'ed as-is.
+//
+// struct abstract_layout {
+//   static const uint ID;
+//   static const char* cache_suffix();
+//   // Bytes taken by an index which differs from the previous index of the point by `delta`.
+//   static uint index_value_bytes(uint delta);
+//   // Bytes taken by all indices of a point, `value_bytes` is the sum of index_value_bytes.
+//   static uint64_t index_bytes(uint count, uint64_t value_bytes);
+//   static uint64_t buffer_size(uint size, uint64_t nnz, uint64_t index_bytes);
+//   void attach(char* buffer, uint size, uint64_t nnz, uint64_t index_bytes);
+//   // Reserves space for a point with `count` features at `position`,
+//   // `nnz_before` features with `bytes_before` bytes of indices precede it.
+//   point_writer place(uint position, uint64_t nnz_before, uint64_t bytes_before, uint count);
+//   // Must be called once the point returned by place is filled.
+//   void seal(uint position, uint count, const point_writer& writer);
+//   data_point get(uint index) const;
+//   template<typename F> void for_each(uint start, uint end, F f) const;
+// };
+
+// Points are stored one after another as [size][label][indices...][values...]
+// and are reached through a table of offsets.
+struct row_layout {
+  static const uint ID = 1;
+  char* data = nullptr;
+  const uint64_t* offsets = nullptr;
+  uint size = 0;
+
+  static const char* cache_suffix() {
+      return "";
+  }
+
+  static uint index_value_bytes(uint) {
+      return SIZE_UINT;
+  }
+
+  static uint64_t index_bytes(uint, uint64_t value_bytes) {
+      return value_bytes;
+  }
+
+  static uint64_t buffer_size(uint size, uint64_t nnz, uint64_t) {
+      return SIZE_OFFSET * size + (SIZE_UINT + SIZE_FP_TYPE) * size + (SIZE_UINT + SIZE_FEATURE) * nnz;
+  }
+
+  void attach(char* buffer, uint _size, uint64_t, uint64_t) {
+      data = buffer;
+      offsets = reinterpret_cast<const uint64_t*>(buffer);
+      size = _size;
+  }
+
+  point_writer place(uint position, uint64_t nnz_before, uint64_t, uint count) {
+      const uint64_t offset = SIZE_OFFSET * size + (SIZE_UINT + SIZE_FP_TYPE) * position + (SIZE_UINT + SIZE_FEATURE) * nnz_before;
+      reinterpret_cast<uint64_t*>(data)[position] = offset;
+      char* buffer = data + offset;
+      *reinterpret_cast<uint*>(buffer) = count;
+      buffer += SIZE_UINT;
+      point_writer writer{};
+      writer.label = reinterpret_cast<fp_type*>(buffer);
+      buffer += SIZE_FP_TYPE;
+      writer.indices = reinterpret_cast<uint*>(buffer);
+      buffer += SIZE_UINT * count;
+      writer.data = reinterpret_cast<feature_type*>(buffer);
+      return writer;
+  }
+
+  void seal(uint, uint, const point_writer&) {}
+
+  inline data_point get(const uint index) const {
+      data_point point{};
+      const char* buffer = data + offsets[index];
+      const uint point_size = *reinterpret_cast<const uint*>(buffer);
+      point.size = point_size;
+      buffer += SIZE_UINT;
+      point.label = *reinterpret_cast<const fp_type*>(buffer);
+      buffer += SIZE_FP_TYPE;
+      point.indices = reinterpret_cast<const uint*>(buffer);
+      buffer += SIZE_UINT * point_size;
+      point.data = reinterpret_cast<const feature_type*>(buffer);
+      return point;
+  }
+
+  template<typename F>
+  inline void for_each(const uint start, const uint end, F f) const {
+      for (uint i = start; i < end; ++i) {
+          f(get(i));
+      }
+  }
+};
+
+// Compressed sparse rows: [row_offsets (size + 1)][labels (size)][indices (nnz)][values (nnz)].
+// The values array is empty for binary features.
+// Every array starts at a cache line boundary, so values are always naturally aligned
+// and a block of consecutive points is one contiguous range of indices and values.
+struct csr_layout {
+  static const uint ID = 2;
+  uint64_t* row_offsets = nullptr;
+  fp_type* labels = nullptr;
+  uint* indices = nullptr;
+  feature_type* values = nullptr;
+  uint size = 0;
+  uint64_t nnz = 0;
+
+  static const char* cache_suffix() {
+      return ".csr";
+  }
+
+  static uint64_t labels_offset(uint size) {
+      return align_to_cache_line(SIZE_OFFSET * (size + 1ull));
+  }
+
+  static uint64_t indices_offset(uint size) {
+      return align_to_cache_line(labels_offset(size) + SIZE_FP_TYPE * size);
+  }
+
+  static uint64_t values_offset(uint size, uint64_t nnz) {
+      return align_to_cache_line(indices_offset(size) + SIZE_UINT * nnz);
+  }
+
+  static uint index_value_bytes(uint) {
+      return SIZE_UINT;
+  }
+
+  static uint64_t index_bytes(uint, uint64_t value_bytes) {
+      return value_bytes;
+  }
+
+  static uint64_t buffer_size(uint size, uint64_t nnz, uint64_t) {
+      return align_to_cache_line(values_offset(size, nnz) + SIZE_FEATURE * nnz);
+  }
+
+  void attach(char* buffer, uint _size, uint64_t _nnz, uint64_t) {
+      size = _size;
+      nnz = _nnz;
+      row_offsets = reinterpret_cast<uint64_t*>(buffer);
+      labels = reinterpret_cast<fp_type*>(buffer + labels_offset(size));
+      indices = reinterpret_cast<uint*>(buffer + indices_offset(size));
+      values = reinterpret_cast<feature_type*>(buffer + values_offset(size, nnz));
+  }
+
+  point_writer place(uint position, uint64_t nnz_before, uint64_t, uint) {
+      row_offsets[position] = nnz_before;
+      if (position + 1 == size) row_offsets[size] = nnz;
+      point_writer writer{};
+      writer.label = labels + position;
+      writer.indices = indices + nnz_before;
+      writer.data = values + nnz_before;
+      return writer;
+  }
+
+  void seal(uint, uint, const point_writer&) {}
+
+  inline data_point get(const uint index) const {
+      data_point point{};
+      const uint64_t begin = row_offsets[index];
+      point.size = row_offsets[index + 1] - begin;
+      point.label = labels[index];
+      point.indices = indices + begin;
+      point.data = values + begin;
+      return point;
+  }
+
+  // Streams [start, end) as one contiguous range without re-reading the row offsets of each point.
+  template<typename F>
+  inline void for_each(const uint start, const uint end, F f) const {
+      if (start >= end) return;
+      uint64_t current = row_offsets[start];
+      data_point point{};
+      for (uint i = start; i < end; ++i) {
+          const uint64_t next = row_offsets[i + 1];
+          point.size = next - current;
+          point.label = labels[i];
+          point.indices = indices + current;
+          point.data = values + current;
+          f(point);
+          current = next;
+      }
+  }
+};
+
+// CSR with delta + StreamVByte coded indices (see stream_vbyte.h):
+// [nnz_offsets (size + 1)][byte_offsets (size + 1)][labels (size)][values (nnz)][index streams].
+// Indices of a point are decoded into a per-thread buffer, so a data_point returned by get or for_each
+// stays valid only until the next point is read from a vbyte_layout dataset on the same thread.
+struct vbyte_layout {
+  static const uint ID = 3;
+  uint64_t* nnz_offsets = nullptr;
+  uint64_t* byte_offsets = nullptr;
+  fp_type* labels = nullptr;
+  feature_type* values = nullptr;
+  uint8_t* stream = nullptr;
+  uint size = 0;
+  uint64_t nnz = 0;
+  uint64_t stream_bytes = 0;
+
+  static const char* cache_suffix() {
+      return ".vbyte";
+  }
+
+  static uint index_value_bytes(uint delta) {
+      return stream_vbyte::value_bytes(delta);
+  }
+
+  static uint64_t index_bytes(uint count, uint64_t value_bytes) {
+      return stream_vbyte::encoded_size(count, value_bytes);
+  }
+
+  static uint64_t byte_offsets_offset(uint size) {
+      return align_to_cache_line(SIZE_OFFSET * (size + 1ull));
+  }
+
+  static uint64_t labels_offset(uint size) {
+      return align_to_cache_line(byte_offsets_offset(size) + SIZE_OFFSET * (size + 1ull));
+  }
+
+  static uint64_t values_offset(uint size) {
+      return align_to_cache_line(labels_offset(size) + SIZE_FP_TYPE * size);
+  }
+
+  static uint64_t stream_offset(uint size, uint64_t nnz) {
+      return align_to_cache_line(values_offset(size) + SIZE_FEATURE * nnz);
+  }
+
+  static uint64_t buffer_size(uint size, uint64_t nnz, uint64_t index_bytes) {
+      return align_to_cache_line(stream_offset(size, nnz) + index_bytes + stream_vbyte::DECODE_PADDING);
+  }
+
+  void attach(char* buffer, uint _size, uint64_t _nnz, uint64_t _stream_bytes) {
+      size = _size;
+      nnz = _nnz;
+      stream_bytes = _stream_bytes;
+      nnz_offsets = reinterpret_cast<uint64_t*>(buffer);
+      byte_offsets = reinterpret_cast<uint64_t*>(buffer + byte_offsets_offset(size));
+      labels = reinterpret_cast<fp_type*>(buffer + labels_offset(size));
+      values = reinterpret_cast<feature_type*>(buffer + values_offset(size));
+      stream = reinterpret_cast<uint8_t*>(buffer + stream_offset(size, nnz));
+  }
+
+  point_writer place(uint position, uint64_t nnz_before, uint64_t bytes_before, uint count) {
+      nnz_offsets[position] = nnz_before;
+      byte_offsets[position] = bytes_before;
+      if (position + 1 == size) {
+          nnz_offsets[size] = nnz;
+          byte_offsets[size] = stream_bytes;
+          std::fill(stream + stream_bytes, stream + stream_bytes + stream_vbyte::DECODE_PADDING, 0);
+      }
+      std::vector<uint>& buffer = encode_buffer();
+      if (buffer.size() < count) buffer.resize(count);
+      point_writer writer{};
+      writer.label = labels + position;
+      writer.indices = buffer.data();
+      writer.data = values + nnz_before;
+      return writer;
+  }
+
+  void seal(uint position, uint count, const point_writer& writer) {
+      stream_vbyte::encode(writer.indices, count, stream + byte_offsets[position]);
+  }
+
+  inline data_point get(const uint index) const {
+      const uint64_t begin = nnz_offsets[index];
+      return decode(index, begin, nnz_offsets[index + 1] - begin);
+  }
+
+  template<typename F>
+  inline void for_each(const uint start, const uint end, F f) const {
+      if (start >= end) return;
+      uint64_t current = nnz_offsets[start];
+      for (uint i = start; i < end; ++i) {
+          const uint64_t next = nnz_offsets[i + 1];
+          f(decode(i, current, next - current));
+          current = next;
+      }
+  }
+
+private:
+  static std::vector<uint>& encode_buffer() {
+      static thread_local std::vector<uint> buffer;
+      return buffer;
+  }
+
+  static std::vector<uint>& decode_buffer() {
+      static thread_local std::vector<uint> buffer;
+      return buffer;
+  }
+
+  inline data_point decode(const uint index, const uint64_t begin, const uint count) const {
+      std::vector<uint>& buffer = decode_buffer();
+      if (unlikely(buffer.size() < count + 4)) buffer.resize(count + 4);
+      stream_vbyte::decode(stream + byte_offsets[index], count, buffer.data());
+      data_point point{};
+      point.size = count;
+      point.label = labels[index];
+      point.indices = buffer.data();
+      point.data = values + begin;
+      return point;
+  }
+};
+
+#ifndef DATASET_LAYOUT
+#define DATASET_LAYOUT row_layout
+#endif
+
+#endif //PSGD_DATASET_LAYOUT_H
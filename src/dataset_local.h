@@ -6,14 +6,47 @@
 #define PSGD_DATASET_LOCAL_H
 
 #include "vectors.h"
+#include "dataset_layout.h"
+#include "libsvm_parser.h"
 #include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <random>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-const uint SIZE_UINT = sizeof(uint);
-const uint SIZE_FP_TYPE = sizeof(fp_type);
-const uint SIZE_CHAR_PTR = sizeof(char*);
+// Binary cache of a dataset_local buffer. It is written next to the source file after parsing
+// and mmap'ed on later runs, so the file layout is exactly the in-memory layout:
+// [header (64 bytes)][layout buffer...]
+// All references inside the buffer are offsets, so no relocation is required.
+// The cache name is <source><layout suffix><value suffix>.bin, e.g. data/rcv1.csr.f32.bin.
+const char DATASET_CACHE_MAGIC[8] = {'P', 'S', 'G', 'D', 'D', 'A', 'T', 'A'};
+const uint DATASET_CACHE_VERSION = 5;
+
+struct dataset_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t fp_size;
+  uint32_t size;
+  uint32_t features;
+  uint64_t buffer_size;
+  uint64_t source_size;
+  int64_t source_mtime;
+  uint16_t reserved_flags;
+  uint16_t feature_size;
+  uint32_t layout;
+  uint64_t nnz;
+  uint64_t index_bytes;
+  char reserved[56];
+};
+
+static_assert(sizeof(dataset_file_header) % CACHE_LINE_SIZE == 0, "Dataset cache header must keep the buffer cache-line aligned.");
 
 struct tmp_point {
   std::vector<fp_type> data;
@@ -21,13 +54,6 @@ struct tmp_point {
   fp_type label{};
 };
 
-struct data_point {
-  uint size;
-  fp_type label;
-  const uint* indices;
-  const fp_type* data;
-};
-
 std::vector<tmp_point> load_dataset_from_file(const std::string& name) {
     std::ifstream in;
     in.open(name);
@@ -43,8 +69,8 @@ std::vector<tmp_point> load_dataset_from_file(const std::string& name) {
         fp_type x{};
         int index{}, old_index = -1;
         char c{};
-        ss >> x;
-        p.label = (x == 1.0) ? 1.0 : -1.0;
+        if (!(ss >> x)) x = -1.0;
+        p.label = x;
         while (ss >> index >> c >> x) {
             if (c != ':' || index < 1) {
                 std::cerr << "Warning! error while reading dataset, split symbol is " << c << " index=" << index << name << std::endl;
@@ -65,19 +91,68 @@ std::vector<tmp_point> load_dataset_from_file(const std::string& name) {
     return tmp_points;
 }
 
-class dataset_local {
+// New id of every feature, features beyond the map keep their ids.
+struct feature_renumbering {
+  std::vector<uint> new_id;
+
+  inline uint map(const uint index) const {
+      return index < new_id.size() ? new_id[index] : index;
+  }
+};
+
+template<typename Layout>
+class basic_dataset_local {
   uint _size;
   uint _features;
-  uint data_buffer_size;
+  uint64_t _nnz;
+  uint64_t _index_bytes;
+  size_t data_buffer_size;
   char* data;
-  char** points_ptr;
+  Layout layout;
+  // Non-null when the buffer is a view of a mmap'ed cache file.
+  void* mapping;
+  size_t mapping_size;
+  // Point i is stored at order[i], empty when the points are stored in their order.
+  // A shuffled load of a cache permutes the mapped rows through it instead of copying them.
+  std::vector<uint> order;
+  // nnz_prefix[i] is the number of features of the points before point i,
+  // so that ranges of points can be cut by their work rather than by their number.
+  std::vector<uint64_t> nnz_prefix;
 
-  explicit dataset_local(const std::vector <tmp_point>& points, bool shuffle = true)
-      : dataset_local(points.size(), points.data(), shuffle) {}
-public:
-  dataset_local(uint size, const tmp_point* points, bool shuffle = true) : _size(size) {
-      std::vector<uint> p(_size);
-      FOR_N(i, _size) {
+  void count_nnz() {
+      nnz_prefix.assign(_size + 1, 0);
+      uint i = 0;
+      for_each(0, _size, [&](const data_point& point) {
+        nnz_prefix[i + 1] = nnz_prefix[i] + point.size;
+        i++;
+      });
+  }
+
+  explicit basic_dataset_local(const std::vector <tmp_point>& points, bool shuffle = true)
+      : basic_dataset_local(points.size(), points.data(), shuffle) {}
+
+  void allocate(uint size, uint64_t nnz, uint64_t index_bytes) {
+      _size = size;
+      _nnz = nnz;
+      _index_bytes = index_bytes;
+      data_buffer_size = Layout::buffer_size(size, nnz, index_bytes);
+      data = reinterpret_cast<char*>(memory::allocate(std::max<size_t>(data_buffer_size, 1)));
+      layout.attach(data, _size, _nnz, _index_bytes);
+  }
+
+  static uint64_t point_index_bytes(const uint* indices, uint count) {
+      uint64_t value_bytes = 0;
+      uint previous = 0;
+      FOR_N(i, count) {
+          value_bytes += Layout::index_value_bytes(indices[i] - previous);
+          previous = indices[i];
+      }
+      return Layout::index_bytes(count, value_bytes);
+  }
+
+  static std::vector<uint> create_order(uint size, bool shuffle) {
+      std::vector<uint> p(size);
+      FOR_N(i, size) {
           p[i] = i;
       }
       if (shuffle) {
@@ -85,67 +160,349 @@ public:
           std::mt19937 g(rd());
           std::shuffle(p.begin(), p.end(), g);
       }
+      return p;
+  }
+
+  static std::string cache_name(const std::string& name) {
+      return name + Layout::cache_suffix() + feature_traits::cache_suffix() + ".bin";
+  }
+
+  static void get_source_stat(const std::string& name, struct stat& st) {
+      if (stat(name.c_str(), &st) != 0) {
+          std::cerr << "Failed to load dataset from " << name << std::endl;
+          exit(1);
+      }
+  }
+
+  bool map_cache(const std::string& name) {
+      struct stat source{};
+      get_source_stat(name, source);
+      const int fd = open(cache_name(name).c_str(), O_RDONLY);
+      if (fd < 0) return false;
+
+      dataset_file_header header{};
+      struct stat st{};
+      const bool valid = fstat(fd, &st) == 0
+                         && pread(fd, &header, sizeof(header), 0) == sizeof(header)
+                         && memcmp(header.magic, DATASET_CACHE_MAGIC, sizeof(header.magic)) == 0
+                         && header.version == DATASET_CACHE_VERSION
+                         && header.fp_size == SIZE_FP_TYPE
+                         && header.feature_size == SIZE_FEATURE
+                         && header.layout == Layout::ID
+                         && header.source_size == static_cast<uint64_t>(source.st_size)
+                         && header.source_mtime == static_cast<int64_t>(source.st_mtime)
+                         && header.buffer_size == Layout::buffer_size(header.size, header.nnz, header.index_bytes)
+                         && static_cast<uint64_t>(st.st_size) == sizeof(header) + header.buffer_size;
+      if (!valid) {
+          close(fd);
+          return false;
+      }
+
+      mapping_size = st.st_size;
+      mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (mapping == MAP_FAILED) {
+          mapping = nullptr;
+          return false;
+      }
+      _size = header.size;
+      _features = header.features;
+      _nnz = header.nnz;
+      _index_bytes = header.index_bytes;
+      data_buffer_size = header.buffer_size;
+      data = reinterpret_cast<char*>(mapping) + sizeof(header);
+      layout.attach(data, _size, _nnz, _index_bytes);
+      return true;
+  }
+
+  void save_cache(const std::string& name) const {
+      struct stat source{};
+      get_source_stat(name, source);
+      dataset_file_header header{};
+      memcpy(header.magic, DATASET_CACHE_MAGIC, sizeof(header.magic));
+      header.version = DATASET_CACHE_VERSION;
+      header.fp_size = SIZE_FP_TYPE;
+      header.size = _size;
+      header.features = _features;
+      header.buffer_size = data_buffer_size;
+      header.source_size = source.st_size;
+      header.source_mtime = source.st_mtime;
+      header.feature_size = SIZE_FEATURE;
+      header.layout = Layout::ID;
+      header.nnz = _nnz;
+      header.index_bytes = _index_bytes;
+
+      // Write into a temporary file first so that a concurrent reader never maps a partial cache.
+      const std::string cache = cache_name(name);
+      const std::string tmp_name = cache + ".tmp";
+      std::ofstream out(tmp_name, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      out.write(data, data_buffer_size);
+      out.close();
+      if (!out || rename(tmp_name.c_str(), cache.c_str()) != 0) {
+          std::cerr << "Warning! failed to write dataset cache " << cache << std::endl;
+          unlink(tmp_name.c_str());
+      }
+  }
+
+  // Sink of the second parsing pass: writes a row right into its place in the buffer.
+  struct write_sink {
+    static const bool need_values = true;
+    Layout& layout;
+    const uint* const position;
+    const uint64_t* const nnz_before;
+    const uint64_t* const bytes_before;
+    const uint* const row_sizes;
+    uint row;
+    uint features = 0;
+    uint64_t ignored = 0;
+    point_writer writer{};
+    uint count = 0;
+    int old_index = -1;
+
+    write_sink(Layout& layout, const uint* position, const uint64_t* nnz_before, const uint64_t* bytes_before,
+               const uint* row_sizes, uint row)
+        : layout(layout), position(position), nnz_before(nnz_before), bytes_before(bytes_before), row_sizes(row_sizes), row(row) {}
+
+    inline void label(fp_type label) {
+        const uint pos = position[row];
+        writer = layout.place(pos, nnz_before[pos], bytes_before[pos], row_sizes[row]);
+        *writer.label = label;
+    }
+
+    inline void feature(uint index, fp_type x) {
+        assert(old_index == -1 || static_cast<int>(index) > old_index);
+        assert(x != 0);
+        old_index = index;
+        if (features < index) features = index;
+        writer.indices[count] = index;
+        feature_traits::set(writer.data, count, x);
+        if (SIZE_FEATURE == 0 && x != 1) ignored++;
+        count++;
+    }
+
+    inline void end_line() {
+        assert(count == row_sizes[row]);
+        layout.seal(position[row], count, writer);
+        row++;
+        count = 0;
+        old_index = -1;
+    }
+  };
+
+  // Parses LIBSVM text on all cores. The first pass computes row sizes, so the buffer is allocated once
+  // and the second pass writes every row straight into its (shuffled) position.
+  void parse_file(const std::string& name, bool shuffle) {
+      const int fd = open(name.c_str(), O_RDONLY);
+      struct stat st{};
+      if (fd < 0 || fstat(fd, &st) != 0) {
+          std::cerr << "Failed to load dataset from " << name << std::endl;
+          exit(1);
+      }
+      const size_t text_size = st.st_size;
+      void* text_mapping = nullptr;
+      if (text_size > 0) {
+          text_mapping = mmap(nullptr, text_size, PROT_READ, MAP_PRIVATE, fd, 0);
+          if (text_mapping == MAP_FAILED) {
+              std::cerr << "Failed to load dataset from " << name << std::endl;
+              exit(1);
+          }
+          madvise(text_mapping, text_size, MADV_WILLNEED);
+      }
+      close(fd);
+      const char* const text = reinterpret_cast<const char*>(text_mapping);
+
+      const uint parts = std::max(1u, std::thread::hardware_concurrency());
+      std::vector<libsvm::chunk> chunks = libsvm::split(text, text_size, parts);
+      libsvm::parallel_for(chunks.size(), [&](uint i) {
+        libsvm::chunk& c = chunks[i];
+        libsvm::size_sink<Layout> sink(c);
+        libsvm::parse_lines(c.begin, c.end, sink, &c.warnings, name);
+      });
+
+      uint size = 0;
+      for (auto& c: chunks) {
+          std::cerr << c.warnings;
+          c.first_row = size;
+          size += c.row_sizes.size();
+      }
+
+      const std::vector<uint> p = create_order(size, shuffle);
+      std::vector<uint> row_sizes(size);
+      std::vector<uint> row_bytes(size);
+      for (auto& c: chunks) {
+          std::copy(c.row_sizes.begin(), c.row_sizes.end(), row_sizes.begin() + c.first_row);
+          std::copy(c.row_bytes.begin(), c.row_bytes.end(), row_bytes.begin() + c.first_row);
+      }
+      std::vector<uint> position(size);
+      std::vector<uint64_t> nnz_before(size);
+      std::vector<uint64_t> bytes_before(size);
+      uint64_t nnz = 0, index_bytes = 0;
+      FOR_N(i, size) {
+          position[p[i]] = i;
+          nnz_before[i] = nnz;
+          bytes_before[i] = index_bytes;
+          nnz += row_sizes[p[i]];
+          index_bytes += row_bytes[p[i]];
+      }
+      allocate(size, nnz, index_bytes);
 
-      data_buffer_size = 0;
-      data_buffer_size += SIZE_CHAR_PTR * _size; // pointers to points
+      std::vector<uint> chunk_features(chunks.size(), 0);
+      std::vector<uint64_t> chunk_ignored(chunks.size(), 0);
+      libsvm::parallel_for(chunks.size(), [&](uint i) {
+        const libsvm::chunk& c = chunks[i];
+        write_sink sink(layout, position.data(), nnz_before.data(), bytes_before.data(), row_sizes.data(), c.first_row);
+        libsvm::parse_lines(c.begin, c.end, sink, nullptr, name);
+        assert(sink.row == c.first_row + c.row_sizes.size());
+        chunk_features[i] = sink.features;
+        chunk_ignored[i] = sink.ignored;
+      });
+      _features = 0;
+      uint64_t ignored = 0;
+      FOR_N(i, chunks.size()) {
+          _features = std::max(_features, chunk_features[i]);
+          ignored += chunk_ignored[i];
+      }
+      _features++;
+      if (ignored > 0) {
+          std::cerr << "Warning! " << ignored << " of " << _nnz << " feature values of " << name
+                    << " are not equal to 1 and are ignored by binary features" << std::endl;
+      }
+
+      if (text_mapping != nullptr) {
+          munmap(text_mapping, text_size);
+      }
+  }
+
+  // Fills the buffer with the points `points` of `other` in this order.
+  void select(const basic_dataset_local& other, const std::vector<uint>& points) {
+      uint64_t nnz = 0, index_bytes = 0;
+      for (const uint index: points) {
+          const data_point point = other[index];
+          nnz += point.size;
+          index_bytes += point_index_bytes(point.indices, point.size);
+      }
+      allocate(points.size(), nnz, index_bytes);
+      uint64_t nnz_before = 0, bytes_before = 0;
       FOR_N(i, _size) {
-          const tmp_point& point = points[p[i]];
-          data_buffer_size += SIZE_UINT; // size of point
-          data_buffer_size += SIZE_FP_TYPE; // label
-          data_buffer_size += SIZE_UINT * point.indices.size();
-          data_buffer_size += SIZE_FP_TYPE * point.indices.size();
-      }
-      data = new char[data_buffer_size];
-      points_ptr = reinterpret_cast<char**>(data);
+          const data_point point = other[points[i]];
+          point_writer writer = layout.place(i, nnz_before, bytes_before, point.size);
+          nnz_before += point.size;
+          bytes_before += point_index_bytes(point.indices, point.size);
+          *writer.label = point.label;
+          std::copy(point.indices, point.indices + point.size, writer.indices);
+          if (SIZE_FEATURE > 0) std::copy(point.data, point.data + point.size, writer.data);
+          layout.seal(i, point.size, writer);
+      }
+      assert(nnz_before == _nnz && bytes_before == _index_bytes);
+  }
+
+public:
+  basic_dataset_local(uint size, const tmp_point* points, bool shuffle = true) : mapping(nullptr), mapping_size(0) {
+      const std::vector<uint> p = create_order(size, shuffle);
+      uint64_t nnz = 0, index_bytes = 0;
+      FOR_N(i, size) {
+          nnz += points[i].indices.size();
+          index_bytes += point_index_bytes(points[i].indices.data(), points[i].indices.size());
+      }
+      allocate(size, nnz, index_bytes);
+
       _features = 0;
-      char* buffer = data + SIZE_CHAR_PTR * _size;
+      uint64_t nnz_before = 0, bytes_before = 0;
       FOR_N(p_i, _size) {
-          const uint point_i = p[p_i];
-          points_ptr[p_i] = buffer;
-          const tmp_point& point = points[point_i];
-          uint size = point.indices.size();
-          *reinterpret_cast<uint*>(buffer) = size;
-          buffer += SIZE_UINT;
-          *reinterpret_cast<fp_type*>(buffer) = point.label;
-          buffer += SIZE_FP_TYPE;
-          FOR_N(i, size) {
-              uint index = point.indices[i];
+          const tmp_point& point = points[p[p_i]];
+          const uint point_size = point.indices.size();
+          point_writer writer = layout.place(p_i, nnz_before, bytes_before, point_size);
+          nnz_before += point_size;
+          bytes_before += point_index_bytes(point.indices.data(), point_size);
+          *writer.label = point.label;
+          FOR_N(i, point_size) {
+              const uint index = point.indices[i];
               if (_features < index) _features = index;
-              *reinterpret_cast<uint*>(buffer) = index;
-              buffer += SIZE_UINT;
-          }
-          FOR_N(i, size) {
-              *reinterpret_cast<fp_type*>(buffer) = point.data[i];
-              buffer += SIZE_FP_TYPE;
+              writer.indices[i] = index;
+              feature_traits::set(writer.data, i, point.data[i]);
           }
+          layout.seal(p_i, point_size, writer);
       }
       _features++;
+      count_nnz();
   }
 
-  explicit dataset_local(const std::string& name, bool shuffle = true) : dataset_local(load_dataset_from_file(name), shuffle) {}
+  // Loads the dataset from the binary cache if it is up to date, otherwise parses LIBSVM text and writes the cache.
+  // The cache holds the rows in file order, so that every load draws a permutation of its own over the mapped rows.
+  explicit basic_dataset_local(const std::string& name, bool shuffle = true, bool use_cache = true) : mapping(nullptr), mapping_size(0) {
+      if (!use_cache) {
+          parse_file(name, shuffle);
+      } else {
+          if (!map_cache(name)) {
+              parse_file(name, false);
+              save_cache(name);
+          }
+          if (shuffle) {
+              order = create_order(_size, true);
+              // The rows are read out of file order, so fault the cache in ahead of the first epoch.
+              if (mapping != nullptr) madvise(mapping, mapping_size, MADV_WILLNEED);
+          }
+      }
+      count_nnz();
+  }
 
-  dataset_local(const dataset_local& other) : _size(other._size), _features(other._features), data_buffer_size(other.data_buffer_size) {
-      data = new char[data_buffer_size];
+  basic_dataset_local(const basic_dataset_local& other)
+          : _features(other._features), mapping(nullptr), mapping_size(0), order(other.order), nnz_prefix(other.nnz_prefix) {
+      allocate(other._size, other._nnz, other._index_bytes);
       std::copy(other.data, other.data + data_buffer_size, data);
-      points_ptr = reinterpret_cast<char**>(data);
   }
 
-  dataset_local(const dataset_local& other, const std::vector<uint>& inverse_permutation) 
-          : _size(other._size), _features(other._features), data_buffer_size(other.data_buffer_size) {
-      assert(_size == inverse_permutation.size());
-      data = new char[data_buffer_size];
-      points_ptr = reinterpret_cast<char**>(data);
-      char* current = data + _size * SIZE_CHAR_PTR;
+  // Point i of the copy is point points[i] of `other`: a permutation of it or a subset (e.g. a node shard).
+  basic_dataset_local(const basic_dataset_local& other, const std::vector<uint>& points)
+          : _features(other._features), mapping(nullptr), mapping_size(0) {
+      select(other, points);
+      count_nnz();
+  }
+
+  // Copy of `other` with the features renumbered, the indices of every point are sorted again.
+  basic_dataset_local(const basic_dataset_local& other, const feature_renumbering& renumbering)
+          : _features(other._features), mapping(nullptr), mapping_size(0) {
+      std::vector<std::pair<uint, fp_type>> features;
+      const auto load = [&](const data_point& point) {
+        features.resize(point.size);
+        FOR_N(j, point.size) {
+            features[j] = std::make_pair(renumbering.map(point.indices[j]), feature_traits::get(point.data, j));
+        }
+        std::sort(features.begin(), features.end());
+      };
+      std::vector<uint> indices;
+      uint64_t index_bytes = 0;
+      FOR_N(i, other._size) {
+          load(other[i]);
+          indices.resize(features.size());
+          FOR_N(j, features.size()) {
+              indices[j] = features[j].first;
+          }
+          index_bytes += point_index_bytes(indices.data(), indices.size());
+      }
+      allocate(other._size, other._nnz, index_bytes);
+
+      uint64_t nnz_before = 0, bytes_before = 0;
       FOR_N(i, _size) {
-          assert(data + _size * SIZE_CHAR_PTR <= current && current < data + data_buffer_size);
-          points_ptr[i] = current;
-          uint index = inverse_permutation[i];
-          data_point point = other[index];
-          char* buffer = other.points_ptr[index];
-          uint length = (SIZE_UINT + SIZE_FP_TYPE) * (point.size + 1);
-          std::copy(buffer, buffer + length, current);
-          current += length;
+          const data_point point = other[i];
+          const fp_type label = point.label;
+          load(point);
+          const uint point_size = features.size();
+          point_writer writer = layout.place(i, nnz_before, bytes_before, point_size);
+          *writer.label = label;
+          FOR_N(j, point_size) {
+              const uint index = features[j].first;
+              if (_features < index + 1) _features = index + 1;
+              writer.indices[j] = index;
+              feature_traits::set(writer.data, j, features[j].second);
+          }
+          nnz_before += point_size;
+          bytes_before += point_index_bytes(writer.indices, point_size);
+          layout.seal(i, point_size, writer);
       }
+      assert(nnz_before == _nnz && bytes_before == _index_bytes);
+      count_nnz();
   }
 
   inline uint get_size() const {
@@ -156,23 +513,59 @@ public:
       return _features;
   }
 
+  inline uint64_t get_nnz() const {
+      return _nnz;
+  }
+
+  inline uint64_t get_index_bytes() const {
+      return _index_bytes;
+  }
+
+  // The layout buffer, it can be attached by another Layout as is. It holds the points in storage order (see `order`).
+  inline const char* get_buffer() const {
+      return data;
+  }
+
+  inline size_t get_buffer_size() const {
+      return data_buffer_size;
+  }
+
+  // First point of part `part` of `parts` parts with (almost) equal numbers of features,
+  // part `parts` ends the dataset. Without features at all the parts have equal numbers of points.
+  inline uint split(const uint part, const uint parts) const {
+      if (part >= parts) return _size;
+      const uint64_t total = nnz_prefix.back();
+      if (total == 0) return static_cast<uint>(static_cast<uint64_t>(_size) * part / parts);
+      const uint64_t target = total * part / parts;
+      return std::lower_bound(nnz_prefix.begin(), nnz_prefix.end(), target) - nnz_prefix.begin();
+  }
+
   inline data_point operator[](const uint index) const {
-      data_point point{};
-      const char* buffer = points_ptr[index];
-      const uint point_size = *reinterpret_cast<const uint*>(buffer);
-      point.size = point_size;
-      buffer += SIZE_UINT;
-      point.label = *reinterpret_cast<const fp_type*>(buffer);
-      buffer += SIZE_FP_TYPE;
-      point.indices = reinterpret_cast<const uint*>(buffer);
-      buffer += SIZE_UINT * point_size;
-      point.data = reinterpret_cast<const fp_type*>(buffer);
-      return point;
-  }
-
-  ~dataset_local() {
-      delete[] data;
+      return layout.get(order.empty() ? index : order[index]);
+  }
+
+  // Calls f(point) for every point in [start, end), the layout may stream the range sequentially
+  // unless the points are permuted.
+  template<typename F>
+  inline void for_each(const uint start, const uint end, F f) const {
+      if (order.empty()) {
+          layout.for_each(start, end, f);
+      } else {
+          for (uint i = start; i < end; ++i) {
+              f(layout.get(order[i]));
+          }
+      }
+  }
+
+  ~basic_dataset_local() {
+      if (mapping != nullptr) {
+          munmap(mapping, mapping_size);
+      } else {
+          memory::release(data, std::max<size_t>(data_buffer_size, 1));
+      }
   }
 };
 
+typedef basic_dataset_local<DATASET_LAYOUT> dataset_local;
+
 #endif //PSGD_DATASET_LOCAL_H
@@ -0,0 +1,408 @@
+//
+// Created by Maksim.Zuev on 17.10.2026.
+//
+
+#ifndef PSGD_DATASET_STREAM_H
+#define PSGD_DATASET_STREAM_H
+
+#include "dataset_local.h"
+#include "block_permutation.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Train set which is never loaded as a whole: it is split into chunks of consecutive points
+// and read from disk chunk by chunk, so only a few chunks are in memory at a time.
+// The chunks live in a stream file next to the source, written once in a single pass over the text:
+// [header (128 bytes)][chunk buffers...][chunk table]
+// Every chunk buffer is a complete Layout buffer of its points (shuffled inside the chunk),
+// it starts at a page boundary and is attached right after a read.
+// The stream name is <source><layout suffix><value suffix>.stream.bin, e.g. data/kdda.csr.f32.stream.bin.
+const char DATASET_STREAM_MAGIC[8] = {'P', 'S', 'G', 'D', 'S', 'T', 'R', 'M'};
+const uint DATASET_STREAM_VERSION = 1;
+const uint STREAM_PAGE_SIZE = 4096;
+// Default number of points in a chunk.
+const uint STREAM_CHUNK_POINTS = 1 << 16;
+// Chunks in memory during training: the workers process one while the next one is read.
+const uint STREAM_BUFFERS = 2;
+
+struct stream_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t fp_size;
+  uint32_t size;
+  uint32_t features;
+  uint32_t chunks;
+  uint32_t chunk_points;
+  uint64_t source_size;
+  int64_t source_mtime;
+  uint64_t table_offset;
+  uint64_t max_buffer_size;
+  uint64_t nnz;
+  uint16_t feature_size;
+  uint16_t reserved_flags;
+  uint32_t layout;
+  char reserved[48];
+};
+
+static_assert(sizeof(stream_file_header) == 128, "Stream header must keep its size.");
+
+struct stream_chunk {
+  uint64_t offset;
+  uint64_t buffer_size;
+  uint64_t nnz;
+  uint64_t index_bytes;
+  uint32_t size;
+  uint32_t reserved;
+};
+
+template<typename Layout>
+class basic_dataset_stream {
+  uint _size;
+  uint _features;
+  uint64_t _nnz;
+  uint64_t max_buffer_size;
+  std::vector<stream_chunk> chunks;
+  int fd;
+
+  // Sink of libsvm::parse_lines which keeps the points of one chunk.
+  struct point_sink {
+    static const bool need_values = true;
+    std::vector<tmp_point>& points;
+
+    explicit point_sink(std::vector<tmp_point>& points) : points(points) {}
+
+    inline void label(fp_type label) {
+        points.emplace_back();
+        points.back().label = label;
+    }
+
+    inline void feature(uint index, fp_type x) {
+        points.back().indices.push_back(index);
+        points.back().data.push_back(x);
+    }
+
+    inline void end_line() {}
+  };
+
+  static std::string stream_name(const std::string& name) {
+      return name + Layout::cache_suffix() + feature_traits::cache_suffix() + ".stream.bin";
+  }
+
+  static void fail(const std::string& message, const std::string& name) {
+      std::cerr << message << ' ' << name << std::endl;
+      exit(1);
+  }
+
+  static bool write_fully(const int out, const char* data, size_t size, uint64_t offset) {
+      while (size > 0) {
+          const ssize_t written = pwrite(out, data, size, offset);
+          if (written <= 0) return false;
+          data += written;
+          size -= written;
+          offset += written;
+      }
+      return true;
+  }
+
+  bool open_stream(const std::string& name, const uint chunk_points) {
+      struct stat source{};
+      if (stat(name.c_str(), &source) != 0) fail("Failed to load dataset from", name);
+      fd = open(stream_name(name).c_str(), O_RDONLY);
+      if (fd < 0) return false;
+
+      stream_file_header header{};
+      struct stat st{};
+      bool valid = fstat(fd, &st) == 0
+                   && pread(fd, &header, sizeof(header), 0) == sizeof(header)
+                   && memcmp(header.magic, DATASET_STREAM_MAGIC, sizeof(header.magic)) == 0
+                   && header.version == DATASET_STREAM_VERSION
+                   && header.fp_size == SIZE_FP_TYPE
+                   && header.feature_size == SIZE_FEATURE
+                   && header.layout == Layout::ID
+                   && header.chunk_points == chunk_points
+                   && header.source_size == static_cast<uint64_t>(source.st_size)
+                   && header.source_mtime == static_cast<int64_t>(source.st_mtime)
+                   && static_cast<uint64_t>(st.st_size) == header.table_offset + header.chunks * sizeof(stream_chunk);
+      if (valid) {
+          chunks.resize(header.chunks);
+          const size_t table_size = header.chunks * sizeof(stream_chunk);
+          valid = pread(fd, chunks.data(), table_size, header.table_offset) == static_cast<ssize_t>(table_size);
+      }
+      if (!valid) {
+          close(fd);
+          fd = -1;
+          chunks.clear();
+          return false;
+      }
+      _size = header.size;
+      _features = header.features;
+      _nnz = header.nnz;
+      max_buffer_size = header.max_buffer_size;
+      return true;
+  }
+
+  // Converts LIBSVM text into a stream file. Only one chunk is parsed and kept in memory at a time,
+  // the text itself is mapped, so it takes page cache rather than process memory.
+  static void write_stream(const std::string& name, const uint chunk_points) {
+      const int in = open(name.c_str(), O_RDONLY);
+      struct stat source{};
+      if (in < 0 || fstat(in, &source) != 0) fail("Failed to load dataset from", name);
+      const size_t text_size = source.st_size;
+      void* text_mapping = nullptr;
+      if (text_size > 0) {
+          text_mapping = mmap(nullptr, text_size, PROT_READ, MAP_PRIVATE, in, 0);
+          if (text_mapping == MAP_FAILED) fail("Failed to load dataset from", name);
+          madvise(text_mapping, text_size, MADV_SEQUENTIAL);
+      }
+      close(in);
+
+      const std::string stream = stream_name(name);
+      const std::string tmp_name = stream + ".tmp";
+      const int out = open(tmp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (out < 0) fail("Failed to write dataset stream", stream);
+
+      stream_file_header header{};
+      memcpy(header.magic, DATASET_STREAM_MAGIC, sizeof(header.magic));
+      header.version = DATASET_STREAM_VERSION;
+      header.fp_size = SIZE_FP_TYPE;
+      header.feature_size = SIZE_FEATURE;
+      header.layout = Layout::ID;
+      header.chunk_points = chunk_points;
+      header.source_size = source.st_size;
+      header.source_mtime = source.st_mtime;
+
+      std::vector<stream_chunk> table;
+      std::vector<tmp_point> points;
+      std::string warnings;
+      bool ok = true;
+      uint64_t offset = STREAM_PAGE_SIZE;
+      const char* p = reinterpret_cast<const char*>(text_mapping);
+      const char* const end = p + text_size;
+      while (p < end && ok) {
+          const char* chunk_end = p;
+          FOR_N(i, chunk_points) {
+              while (chunk_end < end && *chunk_end != '\n') chunk_end++;
+              if (chunk_end == end) break;
+              chunk_end++;
+          }
+          points.clear();
+          point_sink sink(points);
+          libsvm::parse_lines(p, chunk_end, sink, &warnings, name);
+          std::cerr << warnings;
+          warnings.clear();
+          p = chunk_end;
+
+          const basic_dataset_local<Layout> local(points.size(), points.data());
+          stream_chunk chunk{};
+          chunk.offset = offset;
+          chunk.buffer_size = local.get_buffer_size();
+          chunk.nnz = local.get_nnz();
+          chunk.index_bytes = local.get_index_bytes();
+          chunk.size = local.get_size();
+          ok = write_fully(out, local.get_buffer(), chunk.buffer_size, offset);
+          table.push_back(chunk);
+          offset = (offset + chunk.buffer_size + STREAM_PAGE_SIZE - 1) / STREAM_PAGE_SIZE * STREAM_PAGE_SIZE;
+          header.size += chunk.size;
+          header.nnz += chunk.nnz;
+          header.features = std::max(header.features, local.get_features());
+          header.max_buffer_size = std::max<uint64_t>(header.max_buffer_size, chunk.buffer_size);
+      }
+      header.chunks = table.size();
+      header.table_offset = offset;
+      ok = ok && write_fully(out, reinterpret_cast<const char*>(table.data()), table.size() * sizeof(stream_chunk), offset)
+           && write_fully(out, reinterpret_cast<const char*>(&header), sizeof(header), 0);
+      ok = close(out) == 0 && ok;
+      if (text_mapping != nullptr) munmap(text_mapping, text_size);
+      // Renamed only when complete, so that a concurrent reader never opens a partial stream.
+      if (!ok || rename(tmp_name.c_str(), stream.c_str()) != 0) {
+          unlink(tmp_name.c_str());
+          fail("Failed to write dataset stream", stream);
+      }
+  }
+
+public:
+  // Opens the stream file of `name`, writing it first if it is missing or out of date.
+  explicit basic_dataset_stream(const std::string& name, const uint chunk_points = STREAM_CHUNK_POINTS) : fd(-1) {
+      if (open_stream(name, chunk_points)) return;
+      write_stream(name, chunk_points);
+      if (!open_stream(name, chunk_points)) fail("Failed to load dataset stream", stream_name(name));
+  }
+
+  basic_dataset_stream(const basic_dataset_stream&) = delete;
+
+  ~basic_dataset_stream() {
+      if (fd >= 0) close(fd);
+  }
+
+  inline uint get_size() const {
+      return _size;
+  }
+
+  inline uint get_features() const {
+      return _features;
+  }
+
+  inline uint64_t get_nnz() const {
+      return _nnz;
+  }
+
+  inline uint get_chunks() const {
+      return chunks.size();
+  }
+
+  inline uint64_t get_max_buffer_size() const {
+      return max_buffer_size;
+  }
+
+  // Points every one of `threads` workers processes in an epoch at least, see chunk_ring.
+  uint get_points_per_thread(const uint threads) const {
+      uint result = 0;
+      for (const stream_chunk& chunk: chunks) {
+          result += chunk.size / threads;
+      }
+      return result;
+  }
+
+  // Reads chunk `index` into `buffer` (of get_max_buffer_size() bytes), attaches `layout` to it
+  // and returns the number of points.
+  uint read_chunk(const uint index, char* buffer, Layout& layout) const {
+      const stream_chunk& chunk = chunks[index];
+      size_t done = 0;
+      while (done < chunk.buffer_size) {
+          const ssize_t result = pread(fd, buffer + done, chunk.buffer_size - done, chunk.offset + done);
+          if (result <= 0) {
+              std::cerr << "Failed to read dataset stream chunk " << index << std::endl;
+              exit(1);
+          }
+          done += result;
+      }
+      layout.attach(buffer, chunk.size, chunk.nnz, chunk.index_bytes);
+      return chunk.size;
+  }
+
+  // Calls f(point) for every point, chunks are read one by one in the file order.
+  template<typename F>
+  void for_each(F f) const {
+      const size_t bytes = std::max<size_t>(max_buffer_size, 1);
+      char* const buffer = reinterpret_cast<char*>(memory::allocate(bytes));
+      Layout layout;
+      FOR_N(i, chunks.size()) {
+          layout.for_each(0, read_chunk(i, buffer, layout), f);
+      }
+      memory::release(buffer, bytes);
+  }
+};
+
+// Double-buffered reader of a dataset_stream for a training run. A reader thread fills the free buffer
+// with the next chunk while the workers process the other one. Chunk `sequence` of the run is chunk
+// `sequence % chunks` of the epoch `sequence / chunks`, the chunk order is shuffled every epoch.
+// Every worker takes a slice of every chunk and releases the chunk when done with it,
+// a buffer is refilled after all the workers released it.
+template<typename Layout>
+class basic_chunk_ring {
+public:
+  struct slot {
+    char* buffer = nullptr;
+    Layout layout;
+    uint size = 0;
+    uint sequence = 0;
+    uint pending = 0;
+    bool ready = false;
+  };
+
+private:
+  const basic_dataset_stream<Layout>& stream;
+  const uint consumers;
+  const uint total;
+  const size_t buffer_size;
+  slot slots[STREAM_BUFFERS];
+  std::mutex lock;
+  std::condition_variable changed;
+  bool stopping = false;
+  std::thread reader;
+
+  void reader_loop() {
+      const uint chunks = stream.get_chunks();
+      std::vector<uint> order(chunks);
+      FOR_N(i, chunks) {
+          order[i] = i;
+      }
+      FOR_N(sequence, total) {
+          if (sequence % chunks == 0) perm_node::shuffle(order.data(), chunks);
+          slot& s = slots[sequence % STREAM_BUFFERS];
+          {
+              std::unique_lock<std::mutex> guard(lock);
+              changed.wait(guard, [&]() { return stopping || !s.ready; });
+              if (stopping) return;
+          }
+          // The slot is not ready, so no worker reads it.
+          const uint size = stream.read_chunk(order[sequence % chunks], s.buffer, s.layout);
+          {
+              std::lock_guard<std::mutex> guard(lock);
+              s.size = size;
+              s.sequence = sequence;
+              s.pending = consumers;
+              s.ready = true;
+          }
+          changed.notify_all();
+      }
+  }
+
+public:
+  // Reads the chunks of `epochs` epochs for `consumers` workers.
+  basic_chunk_ring(const basic_dataset_stream<Layout>& stream, const uint consumers, const uint epochs)
+      : stream(stream), consumers(consumers), total(stream.get_chunks() * epochs),
+        buffer_size(std::max<size_t>(stream.get_max_buffer_size(), 1)) {
+      FOR_N(i, STREAM_BUFFERS) {
+          slots[i].buffer = reinterpret_cast<char*>(memory::allocate(buffer_size));
+      }
+      reader = std::thread([this]() { reader_loop(); });
+  }
+
+  basic_chunk_ring(const basic_chunk_ring&) = delete;
+
+  ~basic_chunk_ring() {
+      {
+          std::lock_guard<std::mutex> guard(lock);
+          stopping = true;
+      }
+      changed.notify_all();
+      reader.join();
+      FOR_N(i, STREAM_BUFFERS) {
+          memory::release(slots[i].buffer, buffer_size);
+      }
+  }
+
+  inline uint get_chunks() const {
+      return stream.get_chunks();
+  }
+
+  inline uint get_points_per_thread(const uint threads) const {
+      return stream.get_points_per_thread(threads);
+  }
+
+  // Waits until chunk `sequence` is read.
+  const slot& acquire(const uint sequence) {
+      slot& s = slots[sequence % STREAM_BUFFERS];
+      std::unique_lock<std::mutex> guard(lock);
+      changed.wait(guard, [&]() { return s.ready && s.sequence == sequence; });
+      return s;
+  }
+
+  void release(const uint sequence) {
+      slot& s = slots[sequence % STREAM_BUFFERS];
+      bool last;
+      {
+          std::lock_guard<std::mutex> guard(lock);
+          last = --s.pending == 0;
+          if (last) s.ready = false;
+      }
+      if (last) changed.notify_all();
+  }
+};
+
+typedef basic_dataset_stream<DATASET_LAYOUT> dataset_stream;
+typedef basic_chunk_ring<DATASET_LAYOUT> chunk_ring;
+
+#endif //PSGD_DATASET_STREAM_H
@@ -11,7 +11,11 @@
 #include "block_permutation.h"
 #include "cpu_config.h"
 #include <atomic>
-#include "spin_barrier.h"
+#include <cstdint>
+#include "tree_barrier.h"
+#include "block_scheduler.h"
+#include <chrono>
+#include <utility>
 
 
 struct sgd_params {
@@ -20,22 +24,56 @@ struct sgd_params {
   fp_type step_decay;
   fp_type step;
   uint block_size;
+  // Epochs between migrations of a sharded train set, 0 keeps the shards in place.
+  uint migration_period;
+  // Threads which may take the blocks of a thread that is behind, see block_scheduler.h.
+  steal_scope steal;
 };
 
-template<typename T>
+// Worker threads among the first `threads` which run on `node`.
+static uint threads_on_node(const uint node, const uint threads) {
+    uint result = 0;
+    FOR_N(t, threads) {
+        if (config.get_node_for_thread(t) == node) result++;
+    }
+    return result;
+}
+
+// Every thread runs on its own copy of the Task, params and the clone of the data scheme are private.
+// The copies share the pointers, and what the threads write through them is laid out so that no two threads
+// write one cache line:
+// - metrics, idle: one cache_padded slot per thread, combined only after a barrier;
+// - success: written by the threads reaching the target, alone in its line;
+// - deques: each thread allocates its own cache-aligned deque, the array of pointers is written once before a barrier;
+// - models: the model vector of every thread, written once before a barrier;
+// - barrier: the tree nodes pad their arrival and release words, see tree_barrier.h;
+// - perm: every node of the permutation chain is published once with a CAS and only read afterwards.
+// train, ring and validate are read-only while the threads run, except the shards a sharded train set migrates.
+template<typename Model, typename T>
 class Task {
 public:
   sgd_params params;
   T* data_scheme;
-  const dataset& train;
+  // Exactly one of train and ring is set, ring feeds the chunks of a dataset_stream.
+  const dataset* const train;
+  chunk_ring* const ring;
   const dataset& validate;
   const uint threads;
-  spin_barrier* const barrier;
-  metric_summary* const metric;
+  tree_barrier* const barrier;
+  // Validation counts of every thread in the last two epochs, see epoch_metrics.
+  cache_padded<metric_summary>* const metrics;
   permutation* const perm;
-  bool* const success;
+  cache_padded<bool>* const success;
+  // Block deque of every thread, each of them is allocated by its owner.
+  block_deque** const deques;
+  // Seconds every thread waited at the epoch barriers.
+  cache_padded<fp_type>* const idle;
+  // Model vector of every thread, published before the first epoch when the regularisation is lazy.
+  cache_padded<const vector<fp_type>*>* const models;
   const bool copy;
   const uint blocks_per_thread;
+  // Points every thread processes in an epoch at least, the last block of a range also takes the rest.
+  const uint points_per_thread;
 
 
   Task(uint nodes,
@@ -46,28 +84,61 @@ public:
        uint threads)
       : params(*params),
         data_scheme(data_scheme),
-        train(train),
+        train(&train),
+        ring(nullptr),
         validate(validate),
         threads(threads),
-        barrier(new spin_barrier(threads)),
-        metric(new metric_summary[params->max_epochs]),
+        barrier(new tree_barrier(threads)),
+        metrics(new cache_padded<metric_summary>[2 * threads]),
         perm(new permutation(nodes)),
-        success(new bool(false)),
+        success(new cache_padded<bool>()),
+        deques(new block_deque* [threads]()),
+        idle(new cache_padded<fp_type>[threads]()),
+        models(new cache_padded<const vector<fp_type>*>[threads]()),
         copy(false),
-        blocks_per_thread(std::max(1u, train.get_data(0).get_size() / (params->block_size * threads))) {}
+        blocks_per_thread(std::max(1u, train.get_size() / (params->block_size * threads))),
+        points_per_thread(epoch_points(train, threads, blocks_per_thread)) {}
+
+  Task(uint nodes,
+       const sgd_params* params,
+       T* data_scheme,
+       chunk_ring* ring,
+       const dataset& validate,
+       uint threads)
+      : params(*params),
+        data_scheme(data_scheme),
+        train(nullptr),
+        ring(ring),
+        validate(validate),
+        threads(threads),
+        barrier(new tree_barrier(threads)),
+        metrics(new cache_padded<metric_summary>[2 * threads]),
+        perm(new permutation(nodes)),
+        success(new cache_padded<bool>()),
+        deques(new block_deque* [threads]()),
+        idle(new cache_padded<fp_type>[threads]()),
+        models(new cache_padded<const vector<fp_type>*>[threads]()),
+        copy(false),
+        blocks_per_thread(0),
+        points_per_thread(ring->get_points_per_thread(threads)) {}
 
   Task(const Task& other)
       : params(other.params),
         data_scheme(other.data_scheme->clone()),
         train(other.train),
+        ring(other.ring),
         validate(other.validate),
         threads(other.threads),
         barrier(other.barrier),
-        metric(other.metric),
+        metrics(other.metrics),
         perm(other.perm),
         success(other.success),
+        deques(other.deques),
+        idle(other.idle),
+        models(other.models),
         copy(true),
-        blocks_per_thread(other.blocks_per_thread) {}
+        blocks_per_thread(other.blocks_per_thread),
+        points_per_thread(other.points_per_thread) {}
 
   ~Task() {
       if (copy) {
@@ -75,37 +146,106 @@ public:
           return;
       }
       delete barrier;
-      delete[] metric;
+      delete[] metrics;
       delete perm;
       delete success;
+      FOR_N(i, threads) {
+          delete deques[i];
+      }
+      delete[] deques;
+      delete[] idle;
+      delete[] models;
+  }
+
+  // Slots of the threads for epoch e. A thread fills its slot before the epoch barrier and every thread reads
+  // all of them after it, the slot is filled again only after the barrier of epoch e + 1, when nobody reads it.
+  cache_padded<metric_summary>* epoch_metrics(const uint e) const {
+      return metrics + (e % 2) * threads;
+  }
+
+  // Score of epoch e over the slots of all the threads, each thread reduces them on its own after the barrier.
+  fp_type epoch_score(const uint e) const {
+      const cache_padded<metric_summary>* const slots = epoch_metrics(e);
+      metric_summary result;
+      FOR_N(t, threads) {
+          result.plus(slots[t].value);
+      }
+      return result.to_score();
+  }
+
+  // Rank of the thread among the threads training the same model vector and their number, after the publication.
+  std::pair<uint, uint> model_rank(const uint thread_id) const {
+      const vector<fp_type>* const own = models[thread_id].value;
+      uint rank = 0;
+      uint sharers = 0;
+      FOR_N(t, threads) {
+          if (models[t].value != own) continue;
+          if (t < thread_id) rank++;
+          sharers++;
+      }
+      return std::make_pair(rank, sharers);
+  }
+
+private:
+  // Points of the thread with the fewest of them. A thread processes blocks_per_thread consecutive blocks of
+  // its node's part (the whole set or the node's shard), the blocks have equal numbers of features.
+  static uint epoch_points(const dataset& train, const uint threads, const uint blocks_per_thread) {
+      uint result = UINT32_MAX;
+      FOR_N(t, threads) {
+          const uint node = train.is_sharded() ? config.get_node_for_thread(t) : 0;
+          const uint slot = train.is_sharded() ? threads_on_node(node, t) : t;
+          const uint total_blocks = blocks_per_thread * (train.is_sharded() ? threads_on_node(node, threads) : threads);
+          const dataset_local& data = train.get_data(node);
+          const uint points = data.split((slot + 1) * blocks_per_thread, total_blocks) - data.split(slot * blocks_per_thread, total_blocks);
+          result = std::min(result, points);
+      }
+      return result;
   }
 };
 
-template<typename T>
-void* thread_task(void* args, const uint thread_id) {
-    Task<T> task = *reinterpret_cast<Task<T>*>(args);
+// Lazy regularisation applies the decays the threads of a model folded in epoch e, see LazyRegularizationParams.
+// Nobody trains between the epoch barrier and the second one, so every thread of the model rescales its own
+// slice of the vector while no thread reads it.
+template<typename Model, typename T>
+static void fold_lazy_decay(const Task<Model, T>& task, const uint thread_id, const uint e, vector<fp_type>* const w,
+                            typename Model::params* const args, const std::pair<uint, uint>& rank) {
+    const fp_type decay = args->folded_decay(e);
+    const uint start = static_cast<uint>(static_cast<uint64_t>(w->size) * rank.first / rank.second);
+    const uint end = static_cast<uint>(static_cast<uint64_t>(w->size) * (rank.first + 1) / rank.second);
+    fp_type* const __restrict__ vals = w->data;
+    for (uint i = start; i < end; i++) {
+        vals[i] *= decay;
+    }
+    if (rank.first == 0) args->reset_fold(e);
+    task.barrier->wait(thread_id);
+}
+
+template<typename Model, typename T>
+uint thread_task(const Task<Model, T>& shared, const uint thread_id) {
+    Task<Model, T> task = shared;
 
     const uint node = config.get_node_for_thread(thread_id);
-    const dataset_local& train = task.train.get_data(node);
+    const dataset_local* train = &task.train->get_data(node);
     const dataset_local& validate = task.validate.get_data(node);
     T* const scheme = task.data_scheme;
     vector<fp_type>* const w = scheme->get_model_vector(thread_id);
-    auto* const model_args = reinterpret_cast<MODEL_PARAMS*>(scheme->get_model_args(thread_id));
+    auto* const model_args = reinterpret_cast<typename Model::params*>(scheme->get_model_args(thread_id));
 
     perm_node* cluster_perm = task.perm->get_cluster_permutation();
     const uint threads_per_cluster = task.threads / cluster_perm->size;
     const uint blocks_per_thread = task.blocks_per_thread;
-    const uint total_blocks = blocks_per_thread * task.threads;
-    const uint train_size = train.get_size();
-    const uint block_size = train_size / total_blocks;
     const uint blocks_per_cluster = blocks_per_thread * threads_per_cluster;
     const uint cluster_id = thread_id / threads_per_cluster;
     const uint in_cluster_id = thread_id % threads_per_cluster;
-
-    const uint valid_size = validate.get_size();
-    const uint valid_block_size = valid_size / task.threads;
-    const uint valid_start = valid_block_size * thread_id;
-    const uint valid_end = thread_id + 1 == task.threads ? valid_size : valid_block_size * (thread_id + 1);
+    // The threads of a node split the node's shard of a sharded train set. The shards move between the nodes
+    // every migration_period epochs instead of the cluster permutation, which would read other nodes' memory.
+    const bool sharded = task.train->is_sharded();
+    const uint migration_period = sharded ? task.params.migration_period : 0;
+    const uint node_rank = threads_on_node(node, thread_id);
+    const uint total_blocks = blocks_per_thread * (sharded ? threads_on_node(node, task.threads) : task.threads);
+    // Blocks and validation slices have equal numbers of features rather than points, as the work is proportional to them.
+    const uint valid_start = validate.split(thread_id, task.threads);
+    const uint valid_end = validate.split(thread_id + 1, task.threads);
     const fp_type target_score = task.params.target_score;
 
     vector<uint> blocks_perm;
@@ -114,62 +254,179 @@ void* thread_task(void* args, const uint thread_id) {
         blocks_perm[i] = i;
     }
 
+    // A thread done with its blocks takes the rest of the blocks of the victims, the closest first.
+    // Every block is read from the thief's own replica, so only the deque is remote.
+    // The other nodes of a sharded train set hold other points, so stealing stays inside the node.
+    const steal_scope steal = sharded && task.params.steal != steal_scope::none ? steal_scope::node : task.params.steal;
+    block_deque* const deque = new block_deque();
+    task.deques[thread_id] = deque;
+    const std::vector<uint> victims = steal_order(thread_id, task.threads, steal,
+                                                  [&](uint t) { return t / threads_per_cluster; },
+                                                  [](uint t) { return config.get_node_for_thread(t); });
+    task.models[thread_id].value = w;
+    // Every deque is published before anybody steals, every model vector before the ranks are counted.
+    if (steal != steal_scope::none || Model::params::lazy) task.barrier->wait(thread_id);
+    const std::pair<uint, uint> rank = Model::params::lazy ? task.model_rank(thread_id) : std::make_pair(0u, 1u);
+
     const uint n = task.params.max_epochs;
     FOR_N(e, n) {
         const fp_type step = task.params.step;
         const uint c = cluster_perm->permutation[cluster_id];
-        const uint start_block = c * blocks_per_cluster + in_cluster_id * blocks_per_thread;
-
-        FOR_N(block_index, blocks_per_thread) {
-            const uint block = blocks_perm[block_index] + start_block;
-            const uint start = block_size * block;
-            const uint end = block + 1 == total_blocks ? train_size : start + block_size;
-
-            // Update cycle must avoid any unnecessary NUMA communication
-            for (uint i = start; i < end; ++i) {
-                const data_point point = train[i];
-                MODEL_UPDATE(point, w, step, model_args);
-                scheme->post_update(thread_id, step);
-            }
+        const uint start_block = sharded ? node_rank * blocks_per_thread : c * blocks_per_cluster + in_cluster_id * blocks_per_thread;
+        scheme->start_epoch(thread_id, step, task.points_per_thread);
+        deque->reset(blocks_perm.data, start_block, blocks_per_thread);
+
+        const auto process = [&](const uint block) {
+          const uint start = train->split(block, total_blocks);
+          const uint end = train->split(block + 1, total_blocks);
+
+          // Update cycle must avoid any unnecessary NUMA communication
+          train->for_each(start, end, [&](const data_point& point) {
+              Model::update(point, w, step, model_args);
+              scheme->post_update(thread_id, step, point);
+          });
+        };
+        uint block;
+        while (deque->pop(block)) process(block);
+        for (const uint victim: victims) {
+            while (task.deques[victim]->steal(block)) process(block);
         }
         task.params.step *= task.params.step_decay;
         cluster_perm = cluster_perm->gen_next();
 
-        const auto summary = compute_metric(validate, w, valid_start, valid_end);
-        task.metric[e].plus(summary);
-        task.barrier->wait();
-        const fp_type current_score = task.metric[e].to_score();
+        task.epoch_metrics(e)[thread_id].value = compute_metric<Model>(validate, w, model_args, valid_start, valid_end);
+        model_args->fold(e);
+        const auto wait_start = std::chrono::steady_clock::now();
+        task.barrier->wait(thread_id);
+        task.idle[thread_id].value += std::chrono::duration<fp_type>(std::chrono::steady_clock::now() - wait_start).count();
+        if (Model::params::lazy) fold_lazy_decay(task, thread_id, e, w, model_args, rank);
+        const fp_type current_score = task.epoch_score(e);
         if (unlikely(current_score >= target_score)) {
-            *task.success = true;
-            return new uint(e + 1);
+            task.success->value = true;
+            return e + 1;
+        }
+        if (migration_period > 0 && (e + 1) % migration_period == 0) {
+            // Nobody reads the shards after the barrier, the first thread of every node replaces the node's shard.
+            if (node_rank == 0) task.train->migrate(node, (e + 1) / migration_period);
+            task.barrier->wait(thread_id);
+            train = &task.train->get_data(node);
         }
         perm_node::shuffle(blocks_perm.data, blocks_per_thread);
     }
-    return new uint(n);
+    return n;
+}
+
+// thread_task over a dataset_stream: an epoch is a pass over all the chunks in the order of the ring,
+// every thread takes the slice of a chunk its cluster gets in this epoch (cluster permutation as in thread_task).
+template<typename Model, typename T>
+uint streaming_thread_task(const Task<Model, T>& shared, const uint thread_id) {
+    Task<Model, T> task = shared;
+
+    const uint node = config.get_node_for_thread(thread_id);
+    const dataset_local& validate = task.validate.get_data(node);
+    chunk_ring* const ring = task.ring;
+    T* const scheme = task.data_scheme;
+    vector<fp_type>* const w = scheme->get_model_vector(thread_id);
+    auto* const model_args = reinterpret_cast<typename Model::params*>(scheme->get_model_args(thread_id));
+
+    perm_node* cluster_perm = task.perm->get_cluster_permutation();
+    const uint threads = task.threads;
+    const uint threads_per_cluster = threads / cluster_perm->size;
+    const uint cluster_id = thread_id / threads_per_cluster;
+    const uint in_cluster_id = thread_id % threads_per_cluster;
+    const uint chunks = ring->get_chunks();
+    const uint points_per_thread = task.points_per_thread;
+
+    const uint valid_start = validate.split(thread_id, threads);
+    const uint valid_end = validate.split(thread_id + 1, threads);
+    const fp_type target_score = task.params.target_score;
+
+    task.models[thread_id].value = w;
+    // Every model vector is published before the ranks are counted.
+    if (Model::params::lazy) task.barrier->wait(thread_id);
+    const std::pair<uint, uint> rank = Model::params::lazy ? task.model_rank(thread_id) : std::make_pair(0u, 1u);
+
+    const uint n = task.params.max_epochs;
+    FOR_N(e, n) {
+        const fp_type step = task.params.step;
+        const uint slice = cluster_perm->permutation[cluster_id] * threads_per_cluster + in_cluster_id;
+        scheme->start_epoch(thread_id, step, points_per_thread);
+
+        FOR_N(k, chunks) {
+            const uint sequence = e * chunks + k;
+            const chunk_ring::slot& chunk = ring->acquire(sequence);
+            const uint slice_size = chunk.size / threads;
+            const uint start = slice_size * slice;
+            const uint end = slice + 1 == threads ? chunk.size : start + slice_size;
+            chunk.layout.for_each(start, end, [&](const data_point& point) {
+                Model::update(point, w, step, model_args);
+                scheme->post_update(thread_id, step, point);
+            });
+            ring->release(sequence);
+        }
+        task.params.step *= task.params.step_decay;
+        cluster_perm = cluster_perm->gen_next();
+
+        task.epoch_metrics(e)[thread_id].value = compute_metric<Model>(validate, w, model_args, valid_start, valid_end);
+        model_args->fold(e);
+        const auto wait_start = std::chrono::steady_clock::now();
+        task.barrier->wait(thread_id);
+        task.idle[thread_id].value += std::chrono::duration<fp_type>(std::chrono::steady_clock::now() - wait_start).count();
+        if (Model::params::lazy) fold_lazy_decay(task, thread_id, e, w, model_args, rank);
+        const fp_type current_score = task.epoch_score(e);
+        if (unlikely(current_score >= target_score)) {
+            task.success->value = true;
+            return e + 1;
+        }
+    }
+    return n;
 }
 
-template<typename T>
+template<typename Model, typename T, typename F>
+bool execute_task(thread_pool& tp, Task<Model, T>& task, F thread_function, fp_type& epochs, std::vector<fp_type>& idle) {
+    task.data_scheme->start_sync(task.params.step);
+    const std::vector<uint> results = tp.execute([&](const uint thread_id) { return thread_function(task, thread_id); });
+    task.data_scheme->stop_sync();
+    epochs = 0;
+    for (const uint result: results) {
+        epochs += result;
+    }
+    epochs /= tp.get_size();
+    idle.resize(tp.get_size());
+    FOR_N(i, tp.get_size()) {
+        idle[i] = task.idle[i].value;
+    }
+
+    return task.success->value;
+}
+
+template<typename Model, typename T>
 bool run_experiment(
     const dataset& train,
     const dataset& validate,
     thread_pool& tp,
     sgd_params* params,
     T* data_scheme,
-    fp_type& epochs
+    fp_type& epochs,
+    std::vector<fp_type>& idle
 ) {
-    Task<T> task(tp.get_numa_count(), params, data_scheme, train, validate, tp.get_size());
-
-    auto results = tp.execute(thread_task<T>, &task);
-    epochs = 0;
-    FOR_N(i, tp.get_size()) {
-        uint* res = reinterpret_cast<uint*>(results[i]);
-        epochs += *res;
-        delete res;
-    }
-    epochs /= tp.get_size();
-
-    return *task.success;
+    Task<Model, T> task(tp.get_numa_count(), params, data_scheme, train, validate, tp.get_size());
+    return execute_task(tp, task, thread_task<Model, T>, epochs, idle);
 }
 
+template<typename Model, typename T>
+bool run_experiment(
+    const dataset_stream& train,
+    const dataset& validate,
+    thread_pool& tp,
+    sgd_params* params,
+    T* data_scheme,
+    fp_type& epochs,
+    std::vector<fp_type>& idle
+) {
+    chunk_ring ring(train, tp.get_size(), params->max_epochs);
+    Task<Model, T> task(tp.get_numa_count(), params, data_scheme, &ring, validate, tp.get_size());
+    return execute_task(tp, task, streaming_thread_task<Model, T>, epochs, idle);
+}
 
 #endif //PSGD_EXPERIMENT_H
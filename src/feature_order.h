@@ -0,0 +1,86 @@
+//
+// Created by Maksim.Zuev on 17.10.2026.
+//
+
+#ifndef PSGD_FEATURE_ORDER_H
+#define PSGD_FEATURE_ORDER_H
+
+#include "dataset.h"
+#include <algorithm>
+#include <vector>
+
+// Feature ids in the order of the first occurrence in the dataset. Features which appear in the same
+// points get close ids, so a contiguous range of the model holds features updated together.
+// Features absent in the dataset follow the others.
+feature_renumbering first_touch_order(const dataset_local& data) {
+    const uint features = data.get_features();
+    feature_renumbering result;
+    result.new_id.assign(features, features);
+    uint next_id = 0;
+    FOR_N(i, data.get_size()) {
+        const data_point point = data[i];
+        FOR_N(j, point.size) {
+            uint& id = result.new_id[point.indices[j]];
+            if (id == features) id = next_id++;
+        }
+    }
+    FOR_N(f, features) {
+        if (result.new_id[f] == features) result.new_id[f] = next_id++;
+    }
+    return result;
+}
+
+// Feature ids with the `hot` features of the largest degrees first, by decreasing degree (ties by id),
+// and the rest in their order. The hot features then fill the first pages of the model, which HogWildHot
+// keeps private per cluster instead of every page some hot feature falls on.
+feature_renumbering hot_first_order(const dataset_local& data, const uint hot) {
+    const uint features = data.get_features();
+    std::vector<uint64_t> degrees(features, 0);
+    FOR_N(i, data.get_size()) {
+        const data_point point = data[i];
+        FOR_N(j, point.size) {
+            degrees[point.indices[j]]++;
+        }
+    }
+    std::vector<uint> order;
+    FOR_N(f, features) {
+        if (degrees[f] > 0) order.push_back(f);
+    }
+    const uint count = std::min(hot, static_cast<uint>(order.size()));
+    std::partial_sort(order.begin(), order.begin() + count, order.end(), [&](const uint a, const uint b) {
+      return degrees[a] > degrees[b] || (degrees[a] == degrees[b] && a < b);
+    });
+    feature_renumbering result;
+    result.new_id.assign(features, features);
+    FOR_N(i, count) {
+        result.new_id[order[i]] = i;
+    }
+    uint next_id = count;
+    FOR_N(f, features) {
+        if (result.new_id[f] == features) result.new_id[f] = next_id++;
+    }
+    return result;
+}
+
+// Ends of `parts` contiguous feature ranges with about equal numbers of feature occurrences.
+std::vector<uint> balanced_feature_ranges(const dataset_local& data, const uint parts) {
+    const uint features = data.get_features();
+    std::vector<uint64_t> degrees(features, 0);
+    FOR_N(i, data.get_size()) {
+        const data_point point = data[i];
+        FOR_N(j, point.size) {
+            degrees[point.indices[j]]++;
+        }
+    }
+    std::vector<uint> ends(parts, features);
+    const uint64_t nnz = data.get_nnz();
+    uint64_t seen = 0;
+    uint part = 0;
+    FOR_N(f, features) {
+        seen += degrees[f];
+        while (part + 1 < parts && seen * parts >= nnz * (part + 1)) ends[part++] = f + 1;
+    }
+    return ends;
+}
+
+#endif //PSGD_FEATURE_ORDER_H
@@ -0,0 +1,95 @@
+//
+// Created by Maksim.Zuev on 17.10.2026.
+//
+
+#ifndef PSGD_FEATURE_VALUE_H
+#define PSGD_FEATURE_VALUE_H
+
+#include "types.h"
+#include <cstdint>
+#include <cstring>
+
+// Storage types of feature values. The model is always kept in fp_type,
+// while the dataset may store values with a smaller type to save memory bandwidth.
+
+// Upper half of an IEEE float, conversion rounds to the nearest even.
+struct bfloat16 {
+  uint16_t bits;
+};
+
+// Implicit 1.0 value of a binary feature, no value array is stored at all.
+struct binary_value {
+};
+
+template<typename V>
+struct value_traits {
+  static const uint SIZE = sizeof(V);
+
+  static const char* cache_suffix();
+
+  static inline fp_type get(const V* data, const uint i) {
+      return data[i];
+  }
+
+  static inline void set(V* data, const uint i, const fp_type x) {
+      data[i] = static_cast<V>(x);
+  }
+};
+
+template<>
+inline const char* value_traits<double>::cache_suffix() {
+    return "";
+}
+
+template<>
+inline const char* value_traits<float>::cache_suffix() {
+    return ".f32";
+}
+
+template<>
+struct value_traits<bfloat16> {
+  static const uint SIZE = sizeof(bfloat16);
+
+  static const char* cache_suffix() {
+      return ".bf16";
+  }
+
+  static inline fp_type get(const bfloat16* data, const uint i) {
+      const uint32_t bits = static_cast<uint32_t>(data[i].bits) << 16;
+      float result;
+      memcpy(&result, &bits, sizeof(result));
+      return result;
+  }
+
+  static inline void set(bfloat16* data, const uint i, const fp_type x) {
+      const float value = static_cast<float>(x);
+      uint32_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      bits += 0x7fff + ((bits >> 16) & 1);
+      data[i].bits = static_cast<uint16_t>(bits >> 16);
+  }
+};
+
+template<>
+struct value_traits<binary_value> {
+  static const uint SIZE = 0;
+
+  static const char* cache_suffix() {
+      return ".binary";
+  }
+
+  static inline fp_type get(const binary_value*, const uint) {
+      return 1.0;
+  }
+
+  static inline void set(binary_value*, const uint, const fp_type) {}
+};
+
+#ifndef FEATURE_VALUE
+#define FEATURE_VALUE fp_type
+#endif
+
+typedef FEATURE_VALUE feature_type;
+typedef value_traits<feature_type> feature_traits;
+
+#endif //PSGD_FEATURE_VALUE_H
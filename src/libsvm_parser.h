@@ -0,0 +1,257 @@
+//
+// Created by Maksim.Zuev on 17.10.2026.
+//
+
+#ifndef PSGD_LIBSVM_PARSER_H
+#define PSGD_LIBSVM_PARSER_H
+
+#include "types.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <thread>
+
+// Allocation-free scanner of LIBSVM text ("label index:value index:value ...").
+// It mirrors the behaviour of the std::stringstream based load_dataset_from_file:
+// the same labels, the same warnings and the same handling of malformed tokens.
+namespace libsvm {
+  struct chunk {
+    const char* begin;
+    const char* end;
+    uint first_row;
+    std::vector<uint> row_sizes;
+    std::vector<uint> row_bytes;
+    std::string warnings;
+  };
+
+  // Splits [data, data + size) into at most `parts` chunks, each of them ends right after a new line symbol.
+  inline std::vector<chunk> split(const char* data, size_t size, uint parts) {
+      std::vector<chunk> chunks;
+      const char* const end = data + size;
+      const char* begin = data;
+      FOR_N(i, parts) {
+          if (begin == end) break;
+          const char* chunk_end = i + 1 == parts ? end : std::max(begin, data + size / parts * (i + 1));
+          while (chunk_end < end && chunk_end[-1] != '\n') chunk_end++;
+          if (chunk_end == begin) continue;
+          chunk c{};
+          c.begin = begin;
+          c.end = chunk_end;
+          chunks.push_back(c);
+          begin = chunk_end;
+      }
+      return chunks;
+  }
+
+  inline bool is_space(const char c) {
+      return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+  }
+
+  inline bool is_digit(const char c) {
+      return static_cast<unsigned char>(c - '0') < 10;
+  }
+
+  inline const char* skip_spaces(const char* p, const char* const end) {
+      while (p < end && is_space(*p)) p++;
+      return p;
+  }
+
+  inline bool parse_int(const char*& p, const char* const end, int& value) {
+      const char* s = skip_spaces(p, end);
+      bool negative = false;
+      if (s < end && (*s == '-' || *s == '+')) {
+          negative = *s == '-';
+          s++;
+      }
+      if (s == end || !is_digit(*s)) return false;
+      int64_t result = 0;
+      while (s < end && is_digit(*s)) {
+          result = result * 10 + (*s - '0');
+          if (result > INT32_MAX) return false;
+          s++;
+      }
+      value = static_cast<int>(negative ? -result : result);
+      p = s;
+      return true;
+  }
+
+  static const double POWERS_OF_TEN[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  // Falls back to strtod for the numbers which can not be converted exactly by the fast path.
+  inline double slow_parse_double(const char* begin, const char* end) {
+      char buffer[64];
+      const size_t length = end - begin;
+      if (length < sizeof(buffer)) {
+          std::copy(begin, end, buffer);
+          buffer[length] = 0;
+          return strtod(buffer, nullptr);
+      }
+      return strtod(std::string(begin, end).c_str(), nullptr);
+  }
+
+  // When Convert is false the number is only validated, which is enough for the sizing pass.
+  template<bool Convert>
+  inline bool parse_double(const char*& p, const char* const end, fp_type& value) {
+      const char* const start = skip_spaces(p, end);
+      const char* s = start;
+      bool negative = false;
+      if (s < end && (*s == '-' || *s == '+')) {
+          negative = *s == '-';
+          s++;
+      }
+      uint64_t mantissa = 0;
+      int digits = 0, exponent = 0;
+      bool any_digit = false;
+      while (s < end && is_digit(*s)) {
+          any_digit = true;
+          if (digits < 19) {
+              mantissa = mantissa * 10 + (*s - '0');
+              if (mantissa != 0) digits++;
+          } else {
+              exponent++;
+              digits++;
+          }
+          s++;
+      }
+      if (s < end && *s == '.') {
+          s++;
+          while (s < end && is_digit(*s)) {
+              any_digit = true;
+              if (digits < 19) {
+                  mantissa = mantissa * 10 + (*s - '0');
+                  if (mantissa != 0) digits++;
+                  exponent--;
+              } else {
+                  digits++;
+              }
+              s++;
+          }
+      }
+      if (!any_digit) return false;
+      if (s < end && (*s == 'e' || *s == 'E')) {
+          const char* e = s + 1;
+          bool negative_exp = false;
+          if (e < end && (*e == '-' || *e == '+')) {
+              negative_exp = *e == '-';
+              e++;
+          }
+          if (e < end && is_digit(*e)) {
+              int exp_value = 0;
+              while (e < end && is_digit(*e)) {
+                  if (exp_value < 100000) exp_value = exp_value * 10 + (*e - '0');
+                  e++;
+              }
+              exponent += negative_exp ? -exp_value : exp_value;
+              s = e;
+          }
+      }
+      if (Convert) {
+          double result;
+          if (digits <= 19 && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+              result = static_cast<double>(mantissa);
+              result = exponent < 0 ? result / POWERS_OF_TEN[-exponent] : result * POWERS_OF_TEN[exponent];
+              if (negative) result = -result;
+          } else {
+              result = slow_parse_double(start, s);
+          }
+          value = static_cast<fp_type>(result);
+      }
+      p = s;
+      return true;
+  }
+
+  // Parses one line [p, end) and reports it to the sink:
+  // sink.label(fp_type) once and then sink.feature(uint index, fp_type value) for every valid feature.
+  // Warnings are appended to `warnings` if it is not null.
+  template<typename Sink>
+  inline void parse_line(const char* p, const char* const end, Sink& sink, std::string* warnings, const std::string& name) {
+      fp_type x{};
+      if (!parse_double<true>(p, end, x)) {
+          sink.label(-1.0);
+          return;
+      }
+      sink.label(x);
+      while (true) {
+          int index{};
+          char c{};
+          if (!parse_int(p, end, index)) break;
+          p = skip_spaces(p, end);
+          if (p == end) break;
+          c = *p++;
+          if (!parse_double<Sink::need_values>(p, end, x)) break;
+          if (c != ':' || index < 1) {
+              if (warnings != nullptr) {
+                  std::stringstream ss;
+                  ss << "Warning! error while reading dataset, split symbol is " << c << " index=" << index << name << '\n';
+                  warnings->append(ss.str());
+              }
+              continue;
+          }
+          sink.feature(index - 1, x);
+      }
+  }
+
+  // Calls parse_line for every line of [begin, end).
+  template<typename Sink>
+  inline void parse_lines(const char* begin, const char* const end, Sink& sink, std::string* warnings, const std::string& name) {
+      const char* p = begin;
+      while (p < end) {
+          const char* line_end = p;
+          while (line_end < end && *line_end != '\n') line_end++;
+          parse_line(p, line_end, sink, warnings, name);
+          sink.end_line();
+          p = line_end + 1;
+      }
+  }
+
+  // Runs task(i) for every i in [0, n) on its own thread.
+  template<typename F>
+  inline void parallel_for(uint n, const F& task) {
+      std::vector<std::thread> threads;
+      threads.reserve(n);
+      FOR_N(i, n) {
+          threads.emplace_back([&task, i]() { task(i); });
+      }
+      for (auto& thread: threads) {
+          thread.join();
+      }
+  }
+
+  // Sizing pass sink: collects the number of valid features of each row and the bytes taken by their indices,
+  // Encoding provides index_value_bytes(delta) and index_bytes(count, value_bytes) (see dataset_layout.h).
+  template<typename Encoding>
+  struct size_sink {
+    static const bool need_values = false;
+    chunk& c;
+    uint current = 0;
+    uint previous = 0;
+    uint64_t value_bytes = 0;
+
+    explicit size_sink(chunk& c) : c(c) {}
+
+    inline void label(fp_type) {}
+
+    inline void feature(uint index, fp_type) {
+        value_bytes += Encoding::index_value_bytes(index - previous);
+        previous = index;
+        current++;
+    }
+
+    inline void end_line() {
+        c.row_sizes.push_back(current);
+        c.row_bytes.push_back(Encoding::index_bytes(current, value_bytes));
+        current = 0;
+        previous = 0;
+        value_bytes = 0;
+    }
+  };
+}
+
+#endif //PSGD_LIBSVM_PARSER_H
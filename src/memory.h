@@ -0,0 +1,236 @@
+//
+// Created by Maksim.Zuev on 17.10.2026.
+//
+
+#ifndef PSGD_MEMORY_H
+#define PSGD_MEMORY_H
+
+#include "types.h"
+#include "numa.h"
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+// Page kinds an allocation may ask for. Every mode falls back to the next weaker one:
+// hugetlb_1gb -> hugetlb_2mb -> transparent_huge_pages -> regular pages.
+enum huge_page_mode {
+  no_huge_pages,
+  // Regular pages with madvise(MADV_HUGEPAGE), khugepaged may also collapse them later.
+  transparent_huge_pages,
+  // Pages reserved in hugetlbfs (vm.nr_hugepages / hugepagesz=1G).
+  hugetlb_2mb,
+  hugetlb_1gb
+};
+
+// Huge pages used by default, e.g. make SVM_FLAGS="-DHUGE_PAGES=hugetlb_2mb".
+#ifndef HUGE_PAGES
+#define HUGE_PAGES transparent_huge_pages
+#endif
+
+// Allocator of the large buffers: vector data, dataset buffers and models of the data schemes.
+// Allocations of at least one huge page are mmap'ed and aligned to it, smaller ones are
+// cache-line aligned. Memory is not touched here, so the first touch still decides its node
+// unless a node is given explicitly.
+namespace memory {
+  const size_t ALIGNMENT = 64;
+  const size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+  const size_t GIGANTIC_PAGE_SIZE = size_t(1) << 30;
+
+  struct counters {
+    std::atomic<uint64_t> small_bytes{0};
+    std::atomic<uint64_t> mapped_bytes{0};
+    std::atomic<uint64_t> hugetlb_bytes{0};
+    std::atomic<uint64_t> advised_bytes{0};
+    std::atomic<uint64_t> fallbacks{0};
+  };
+
+  struct mapping {
+    size_t size;
+    bool hugetlb;
+    bool advised;
+  };
+
+  inline counters& get_counters() {
+      static counters instance;
+      return instance;
+  }
+
+  // Live mmap'ed allocations, so that release knows their size and stats can find them in smaps.
+  inline std::map<uintptr_t, mapping>& get_mappings() {
+      static std::map<uintptr_t, mapping> instance;
+      return instance;
+  }
+
+  inline std::mutex& get_mappings_lock() {
+      static std::mutex instance;
+      return instance;
+  }
+
+  inline size_t round_up(const size_t value, const size_t unit) {
+      return (value + unit - 1) / unit * unit;
+  }
+
+  inline void* map_hugetlb(const size_t size, const int flag) {
+      void* result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | flag, -1, 0);
+      return result == MAP_FAILED ? nullptr : result;
+  }
+
+  // Maps a huge-page aligned region of `bytes`, trying the page kinds from `mode` down.
+  inline void* map_region(const size_t bytes, huge_page_mode mode, mapping& region) {
+      counters& stats = get_counters();
+      size_t& size = region.size;
+      region.hugetlb = false;
+      region.advised = false;
+      if (mode == hugetlb_1gb) {
+          size = round_up(bytes, GIGANTIC_PAGE_SIZE);
+          if (void* result = map_hugetlb(size, MAP_HUGE_1GB)) {
+              region.hugetlb = true;
+              return result;
+          }
+          stats.fallbacks++;
+          mode = hugetlb_2mb;
+      }
+      if (mode == hugetlb_2mb) {
+          size = round_up(bytes, HUGE_PAGE_SIZE);
+          if (void* result = map_hugetlb(size, MAP_HUGE_2MB)) {
+              region.hugetlb = true;
+              return result;
+          }
+          stats.fallbacks++;
+          mode = transparent_huge_pages;
+      }
+      size = round_up(bytes, HUGE_PAGE_SIZE);
+      // Over-allocate by a huge page and trim, so that the region starts at a huge page boundary.
+      const size_t padded = size + HUGE_PAGE_SIZE;
+      void* raw = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (raw == MAP_FAILED) return nullptr;
+      const uintptr_t start = round_up(reinterpret_cast<uintptr_t>(raw), HUGE_PAGE_SIZE);
+      const size_t head = start - reinterpret_cast<uintptr_t>(raw);
+      if (head > 0) munmap(raw, head);
+      if (padded - head > size) munmap(reinterpret_cast<char*>(start) + size, padded - head - size);
+      void* result = reinterpret_cast<void*>(start);
+      if (mode == transparent_huge_pages) {
+          if (madvise(result, size, MADV_HUGEPAGE) == 0) {
+              region.advised = true;
+          } else {
+              stats.fallbacks++;
+          }
+      }
+      return result;
+  }
+
+  // Allocates `bytes` aligned to at least ALIGNMENT. With `node` >= 0 the pages are bound to that node.
+  inline void* allocate(const size_t bytes, const int node = -1, const huge_page_mode mode = HUGE_PAGES) {
+      if (bytes == 0) return nullptr;
+      counters& stats = get_counters();
+      if (bytes < HUGE_PAGE_SIZE) {
+          void* result = nullptr;
+          if (posix_memalign(&result, ALIGNMENT, bytes) != 0) throw std::bad_alloc();
+          stats.small_bytes += bytes;
+          return result;
+      }
+      mapping region{};
+      void* result = map_region(bytes, mode, region);
+      if (result == nullptr) throw std::bad_alloc();
+      if (node >= 0) numa_tonode_memory(result, region.size, node);
+      stats.mapped_bytes += region.size;
+      if (region.hugetlb) stats.hugetlb_bytes += region.size;
+      if (region.advised) stats.advised_bytes += region.size;
+      {
+          std::lock_guard<std::mutex> guard(get_mappings_lock());
+          get_mappings()[reinterpret_cast<uintptr_t>(result)] = region;
+      }
+      return result;
+  }
+
+  inline void release(void* data, const size_t bytes) {
+      if (data == nullptr) return;
+      counters& stats = get_counters();
+      if (bytes < HUGE_PAGE_SIZE) {
+          stats.small_bytes -= bytes;
+          free(data);
+          return;
+      }
+      mapping region{};
+      {
+          std::lock_guard<std::mutex> guard(get_mappings_lock());
+          auto it = get_mappings().find(reinterpret_cast<uintptr_t>(data));
+          if (it == get_mappings().end()) throw std::runtime_error("Releasing memory which was not allocated.");
+          region = it->second;
+          get_mappings().erase(it);
+      }
+      stats.mapped_bytes -= region.size;
+      if (region.hugetlb) stats.hugetlb_bytes -= region.size;
+      if (region.advised) stats.advised_bytes -= region.size;
+      munmap(data, region.size);
+  }
+
+  // Bytes of the live mmap'ed allocations which are backed by transparent huge pages right now.
+  inline uint64_t transparent_huge_bytes() {
+      std::ifstream smaps("/proc/self/smaps");
+      if (!smaps) return 0;
+      std::lock_guard<std::mutex> guard(get_mappings_lock());
+      const std::map<uintptr_t, mapping>& mappings = get_mappings();
+      uint64_t result = 0;
+      bool ours = false;
+      std::string line;
+      while (std::getline(smaps, line)) {
+          const size_t dash = line.find('-');
+          if (dash != std::string::npos && dash > 0 && line.find(' ') > dash && isxdigit(line[0])) {
+              // A mapping header: "start-end perms ...". A region may be split by the kernel,
+              // so any mapping inside one of ours counts.
+              const uintptr_t start = std::stoull(line.substr(0, dash), nullptr, 16);
+              auto it = mappings.upper_bound(start);
+              ours = it != mappings.begin() && start < (--it)->first + it->second.size;
+              continue;
+          }
+          if (ours && line.compare(0, 14, "AnonHugePages:") == 0) {
+              std::istringstream ss(line.substr(14));
+              uint64_t kb = 0;
+              ss >> kb;
+              result += kb << 10;
+          }
+      }
+      return result;
+  }
+
+  // Prints `bytes` in megabytes with one decimal, without touching the stream format.
+  inline std::string megabytes(const uint64_t bytes) {
+      const uint64_t tenths = (bytes * 10 + (1 << 19)) >> 20;
+      return std::to_string(tenths / 10) + "." + std::to_string(tenths % 10) + "MB";
+  }
+
+  inline void report(std::ostream& out) {
+      const counters& stats = get_counters();
+      out << "Memory: mapped=" << megabytes(stats.mapped_bytes)
+          << " hugetlb=" << megabytes(stats.hugetlb_bytes)
+          << " thp_advised=" << megabytes(stats.advised_bytes)
+          << " thp_backed=" << megabytes(transparent_huge_bytes())
+          << " small=" << megabytes(stats.small_bytes)
+          << " fallbacks=" << stats.fallbacks
+          << std::endl;
+  }
+}
+
+#endif //PSGD_MEMORY_H
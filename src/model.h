@@ -7,132 +7,525 @@
 
 #include "types.h"
 #include "dataset.h"
+#include "dataset_stream.h"
 #include "data_scheme.h"
+#include "simd.h"
 #include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
 
 
-struct SVMParams {
+// Degree-scaled L2 regularisation: every touched coordinate j is shrunk by 1 - step * mu / degree[j].
+struct RegularizationParams {
   const fp_type mu;
   const vector<uint> degrees;
+  // mu / degrees[j], so that the update needs no division; 0 for features absent in the train set.
+  const vector<fp_type> mu_over_degree;
 
-  SVMParams(fp_type mu, const dataset* data) : mu(mu), degrees(calc_degrees(data)) {}
+  // Data is a dataset or a dataset_stream, both provide get_features() and a for_each scan.
+  template<typename Data>
+  RegularizationParams(fp_type mu, const Data* data) : mu(mu), degrees(calc_degrees(data)), mu_over_degree(calc_mu_over_degree(mu, degrees)) {}
+
+  // The shrink is applied by the update itself, there is no decay to fold at the epoch barriers.
+  static const bool lazy = false;
+
+  // Number of model coordinates per feature.
+  inline uint model_outputs() const {
+      return 1;
+  }
+
+  void fold(uint) {}
+
+  fp_type folded_decay(uint) const {
+      return 1;
+  }
+
+  void reset_fold(uint) {}
 
 private:
-  static vector<uint> calc_degrees(const dataset* dataset) {
-      const uint features = dataset->get_features();
+  static vector<fp_type> calc_mu_over_degree(const fp_type mu, const vector<uint>& degrees) {
+      vector<fp_type> result;
+      result.init(degrees.size);
+      FOR_N(j, degrees.size) {
+          result[j] = degrees[j] == 0 ? 0 : mu / degrees[j];
+      }
+      return result;
+  }
+
+  template<typename Data>
+  static vector<uint> calc_degrees(const Data* data) {
+      const uint features = data->get_features();
       vector<uint> degrees;
       degrees.init(features, 0);
-      const dataset_local& points = dataset->get_data(0);
-      const uint size = points.get_size();
-      FOR_N(i, size) {
-          const data_point point = points[i];
-          FOR_N(j, point.size) {
-              degrees[point.indices[j]]++;
-          }
-      }
+      data->for_each([&](const data_point& point) {
+        FOR_N(j, point.size) {
+            degrees[point.indices[j]]++;
+        }
+      });
       return degrees;
   }
 };
 
+// Uniform L2 decay 1 - step * lambda applied after every update, lambda = mu / n matches
+// the degree-scaled shrink of RegularizationParams in expectation. The decay is kept lazily: a thread
+// multiplies only its own pending factor, reads the weights as w = pending * v and writes v accordingly,
+// so decaying all the coordinates is a single multiplication on a thread-local value.
+// The threads of a model do not see each other's decays until the epoch barrier, where every one of them folds
+// its pending factor into the model's product and the vector is rescaled by it, see fold_lazy_decay in experiment.h.
+// The factor belongs to the thread, not to the model: the syncs of the replica schemes work on the stored
+// vectors and take the factors of all the threads equal, see sync_hogwild_XX_scalar in data_scheme.h.
+struct LazyRegularizationParams {
+  static const bool lazy = true;
+  const fp_type lambda;
+
+  template<typename Data>
+  LazyRegularizationParams(fp_type mu, const Data* data) : lambda(mu / data->get_size()), folded(new_folded()) {}
+
+  LazyRegularizationParams(const LazyRegularizationParams& other) : lambda(other.lambda), folded(new_folded()) {}
+
+  ~LazyRegularizationParams() {
+      delete[] folded;
+  }
+
+  // Pending decay of the calling thread.
+  static inline fp_type thread_scale() {
+      return pending;
+  }
+
+  inline uint model_outputs() const {
+      return 1;
+  }
+
+  inline void decay(const fp_type step) {
+      pending *= 1 - step * lambda;
+  }
+
+  // Multiplies the pending factor of the calling thread into the product of epoch e.
+  // Called by every thread of the model after its last update of the epoch and before the epoch barrier.
+  void fold(const uint e) {
+      std::atomic<fp_type>& product = folded[e % 2].value;
+      fp_type current = product.load(std::memory_order_relaxed);
+      while (!product.compare_exchange_weak(current, current * pending, std::memory_order_acq_rel)) {}
+      pending = 1;
+  }
+
+  // Product of the factors folded in epoch e, complete after the epoch barrier.
+  fp_type folded_decay(const uint e) const {
+      return folded[e % 2].value.load(std::memory_order_acquire);
+  }
+
+  // Called by one thread of the model between the two barriers of epoch e: the product of epoch e + 1
+  // was last read before the barrier of epoch e and nobody folds into it before the second barrier.
+  void reset_fold(const uint e) {
+      folded[(e + 1) % 2].value.store(1, std::memory_order_relaxed);
+  }
+
+private:
+  static thread_local fp_type pending;
+  // Products of epochs of both parities, each in its own line.
+  cache_padded<std::atomic<fp_type>>* const folded;
+
+  static cache_padded<std::atomic<fp_type>>* new_folded() {
+      auto* result = new cache_padded<std::atomic<fp_type>>[2];
+      FOR_N(i, 2) {
+          result[i].value.store(1, std::memory_order_relaxed);
+      }
+      return result;
+  }
+};
+
+thread_local fp_type LazyRegularizationParams::pending = 1;
+
 namespace vectors {
-  inline fp_type dot(const fp_type* const __restrict__ a_data,
-                     const data_point& point) {
+  template<typename V>
+  inline fp_type dot_scalar(const fp_type* const __restrict__ a_data,
+                            const uint* const __restrict__ indices,
+                            const V* const __restrict__ b_data,
+                            const uint size) {
       fp_type result = 0;
-      const uint size = point.size;
-      const uint* const __restrict__ indices = point.indices;
-      const fp_type* const __restrict__ b_data = point.data;
       FAST_FOR(i, size) {
           const uint index = indices[i];
-          const fp_type b_val = b_data[i];
+          const fp_type b_val = value_traits<V>::get(b_data, i);
           const fp_type a_val = a_data[index];
           result += a_val * b_val;
       }
       return result;
   }
 
+  template<typename V>
+  inline void scale_and_add_scalar(fp_type* const __restrict__ a_data,
+                                   const uint* const __restrict__ indices,
+                                   const V* const __restrict__ b_data,
+                                   const uint size,
+                                   const fp_type s) {
+      FAST_FOR(i, size) {
+          const uint index = indices[i];
+          const fp_type b_val = value_traits<V>::get(b_data, i);
+          a_data[index] += s * b_val;
+      }
+  }
+
+  // Dispatches to the widest kernel supported by the CPU, short points stay on the scalar path.
+  template<typename V>
+  inline fp_type dot(const fp_type* const __restrict__ a_data,
+                     const uint* const __restrict__ indices,
+                     const V* const __restrict__ b_data,
+                     const uint size) {
+#ifdef PSGD_SIMD
+      if (simd::active == simd::AVX512 && size >= 8) return simd::dot_avx512(a_data, indices, b_data, size);
+      if (simd::active >= simd::AVX2 && size >= 4) return simd::dot_avx2(a_data, indices, b_data, size);
+#endif
+      return dot_scalar(a_data, indices, b_data, size);
+  }
+
+  template<typename V>
+  inline void scale_and_add(fp_type* const __restrict__ a_data,
+                            const uint* const __restrict__ indices,
+                            const V* const __restrict__ b_data,
+                            const uint size,
+                            const fp_type s) {
+#ifdef PSGD_SIMD
+      if (simd::active == simd::AVX512 && size >= 8) return simd::scale_and_add_avx512(a_data, indices, b_data, size, s);
+      if (simd::active >= simd::AVX2 && size >= 4) return simd::scale_and_add_avx2(a_data, indices, b_data, size, s);
+#endif
+      scale_and_add_scalar(a_data, indices, b_data, size, s);
+  }
+
+  inline fp_type dot(const fp_type* const __restrict__ a_data,
+                     const data_point& point) {
+      return dot(a_data, point.indices, point.data, point.size);
+  }
+
   inline void scale_and_add(fp_type* const __restrict__ a_data,
                             const data_point& point,
                             const fp_type s) {
-      const uint size = point.size;
-      const uint* const __restrict__ indices = point.indices;
-      const fp_type* const __restrict__ b_data = point.data;
+      scale_and_add(a_data, point.indices, point.data, point.size, s);
+  }
+
+  // a[j] = (a[j] + s * b[i]) * (1 - step * c[j]) for j = indices[i], i.e. axpy fused with a per-feature shrink.
+  template<typename V>
+  inline void scale_add_shrink_scalar(fp_type* const __restrict__ a_data,
+                                      const uint* const __restrict__ indices,
+                                      const V* const __restrict__ b_data,
+                                      const uint size,
+                                      const fp_type s,
+                                      const fp_type* const __restrict__ c_data,
+                                      const fp_type step) {
       FAST_FOR(i, size) {
           const uint index = indices[i];
-          const fp_type b_val = b_data[i];
-          a_data[index] += s * b_val;
+          const fp_type b_val = value_traits<V>::get(b_data, i);
+          a_data[index] = (a_data[index] + s * b_val) * (1 - step * c_data[index]);
+      }
+  }
+
+  inline void scale_add_shrink(fp_type* const __restrict__ a_data,
+                               const data_point& point,
+                               const fp_type s,
+                               const fp_type* const __restrict__ c_data,
+                               const fp_type step) {
+#ifdef PSGD_SIMD
+      if (simd::active == simd::AVX512 && point.size >= 8) {
+          return simd::scale_add_shrink_avx512(a_data, point.indices, point.data, point.size, s, c_data, step);
+      }
+      if (simd::active >= simd::AVX2 && point.size >= 4) {
+          return simd::scale_add_shrink_avx2(a_data, point.indices, point.data, point.size, s, c_data, step);
+      }
+#endif
+      scale_add_shrink_scalar(a_data, point.indices, point.data, point.size, s, c_data, step);
+  }
+
+  // Multi-output versions over a row-major features x K model, see simd.h.
+  template<typename V>
+  inline void dot_rows_scalar(const fp_type* const __restrict__ a_data,
+                              const uint* const __restrict__ indices,
+                              const V* const __restrict__ b_data,
+                              const uint size,
+                              const uint K,
+                              fp_type* const __restrict__ out) {
+      std::fill(out, out + K, 0);
+      FOR_N(i, size) {
+          const fp_type* const row = a_data + static_cast<size_t>(indices[i]) * K;
+          const fp_type b_val = value_traits<V>::get(b_data, i);
+          FOR_N(k, K) {
+              out[k] += row[k] * b_val;
+          }
+      }
+  }
+
+  template<typename V>
+  inline void scale_add_shrink_rows_scalar(fp_type* const __restrict__ a_data,
+                                           const uint* const __restrict__ indices,
+                                           const V* const __restrict__ b_data,
+                                           const uint size,
+                                           const uint K,
+                                           const fp_type* const __restrict__ e,
+                                           const fp_type* const __restrict__ c_data,
+                                           const fp_type step) {
+      FOR_N(i, size) {
+          const uint j = indices[i];
+          fp_type* const row = a_data + static_cast<size_t>(j) * K;
+          const fp_type b_val = value_traits<V>::get(b_data, i);
+          const fp_type shrink = c_data == nullptr ? 1 : 1 - step * c_data[j];
+          FOR_N(k, K) {
+              row[k] = (row[k] + e[k] * b_val) * shrink;
+          }
+      }
+  }
+
+  inline void dot_rows(const fp_type* const __restrict__ a_data,
+                       const data_point& point,
+                       const uint K,
+                       fp_type* const __restrict__ out) {
+#ifdef PSGD_SIMD
+      if (simd::active == simd::AVX512) {
+          return simd::dot_rows_avx512(a_data, point.indices, point.data, point.size, K, out);
+      }
+      if (simd::active >= simd::AVX2 && K >= 4) {
+          return simd::dot_rows_avx2(a_data, point.indices, point.data, point.size, K, out);
       }
+#endif
+      dot_rows_scalar(a_data, point.indices, point.data, point.size, K, out);
+  }
+
+  inline void scale_add_shrink_rows(fp_type* const __restrict__ a_data,
+                                    const data_point& point,
+                                    const uint K,
+                                    const fp_type* const __restrict__ e,
+                                    const fp_type* const __restrict__ c_data,
+                                    const fp_type step) {
+#ifdef PSGD_SIMD
+      if (simd::active == simd::AVX512) {
+          return simd::scale_add_shrink_rows_avx512(a_data, point.indices, point.data, point.size, K, e, c_data, step);
+      }
+      if (simd::active >= simd::AVX2 && K >= 4) {
+          return simd::scale_add_shrink_rows_avx2(a_data, point.indices, point.data, point.size, K, e, c_data, step);
+      }
+#endif
+      scale_add_shrink_rows_scalar(a_data, point.indices, point.data, point.size, K, e, c_data, step);
   }
 }
 
-namespace svm {
-  static inline bool check(const vector<fp_type>* w, const data_point& point) {
+#ifdef LAZY_REGULARIZATION
+typedef LazyRegularizationParams regularization_params;
+#else
+typedef RegularizationParams regularization_params;
+#endif
+
+// Losses of a linear model, gradient is the negated derivative of the loss by the dot product.
+struct hinge_loss {
+  static const char* name() {
+      return "svm";
+  }
+
+  static inline fp_type gradient(const fp_type dot, const fp_type label) {
+      return dot * label < 1 ? label : 0; // hinge is active.
+  }
+};
+
+struct logistic_loss {
+  static const char* name() {
+      return "logistic";
+  }
+
+  static inline fp_type gradient(const fp_type dot, const fp_type label) {
+      return label / (1 + std::exp(dot * label));
+  }
+};
+
+struct squared_loss {
+  static const char* name() {
+      return "least_squares";
+  }
+
+  static inline fp_type gradient(const fp_type dot, const fp_type label) {
+      return label - dot;
+  }
+};
+
+// Model policy taken by the experiment: a linear model with a given loss and regularisation.
+// A model provides the params type, outputs(args) - the number of model coordinates per feature,
+// update(point, w, step, args) and check(w, point, args).
+template<typename Loss>
+struct linear_model {
+  typedef regularization_params params;
+
+  static std::string name() {
+      return Loss::name();
+  }
+
+  static uint outputs(const params&) {
+      return 1;
+  }
+
+  static inline bool check(const vector<fp_type>* w, const data_point& point, const params*) {
       const fp_type dot = vectors::dot(w->data, point);
-      return std::max(dot * point.label, 0.0) != 0;
+      return std::max(dot * binary_label(point.label), 0.0) != 0;
   }
 
-  static inline void update(const data_point& point, vector<fp_type>* w, const fp_type step, const SVMParams* args) {
+  // Indices of a point are distinct, so the gradient step and the degree-scaled shrink
+  // are applied to every touched coordinate in one pass after the dot product.
+  static inline void update(const data_point& point, vector<fp_type>* w, const fp_type step, const RegularizationParams* args) {
       fp_type* const __restrict__ vals = w->data;
-      const fp_type wxy = vectors::dot(vals, point) * point.label;
+      const fp_type e = step * Loss::gradient(vectors::dot(vals, point), binary_label(point.label));
+      vectors::scale_add_shrink(vals, point, e, args->mu_over_degree.data, step);
+  }
 
-      if (wxy < 1) { // hinge is active.
-          const fp_type e = step * point.label;
-          vectors::scale_and_add(vals, point, e);
+  // w = pending * v, so w + e * x = pending * (v + e / pending * x). Points with a zero gradient do not write at all.
+  static inline void update(const data_point& point, vector<fp_type>* w, const fp_type step, LazyRegularizationParams* args) {
+      fp_type* const __restrict__ vals = w->data;
+      const fp_type scale = args->thread_scale();
+      const fp_type gradient = Loss::gradient(vectors::dot(vals, point) * scale, binary_label(point.label));
+      if (gradient != 0) {
+          vectors::scale_and_add(vals, point, step * gradient / scale);
       }
+      args->decay(step);
+  }
+};
 
-      const uint* const __restrict__ degrees = args->degrees.data;
-      const uint* const __restrict__ indices = point.indices;
-      const fp_type scalar = step * args->mu;
-      const uint size = point.size;
-      FAST_FOR(i, size) {
-          const uint j = indices[i];
-          const uint deg = degrees[j];
-          vals[j] *= 1 - scalar / deg;
+// One-vs-rest over integer labels first_label, ..., first_label + outputs - 1 of the train set.
+struct multiclass_params : public regularization_params {
+  const int first_label;
+  const uint outputs;
+
+  template<typename Data>
+  multiclass_params(fp_type mu, const Data* data) : multiclass_params(mu, data, label_range(data)) {}
+
+  inline uint model_outputs() const {
+      return outputs;
+  }
+
+  // Labels outside of the train set range never match any output.
+  inline int class_of(const fp_type label) const {
+      return static_cast<int>(label) - first_label;
+  }
+
+private:
+  template<typename Data>
+  multiclass_params(fp_type mu, const Data* data, const std::pair<int, int> labels)
+      : regularization_params(mu, data), first_label(labels.first), outputs(labels.second - labels.first + 1) {}
+
+  template<typename Data>
+  static std::pair<int, int> label_range(const Data* data) {
+      int min_label = INT32_MAX;
+      int max_label = INT32_MIN;
+      data->for_each([&](const data_point& point) {
+        const int label = static_cast<int>(point.label);
+        min_label = std::min(min_label, label);
+        max_label = std::max(max_label, label);
+      });
+      return {min_label, max_label};
+  }
+};
+
+// K = outputs binary models with a shared scan of the data: the model is a row-major
+// features x K matrix, so a nonzero loads its index and value once for all the outputs.
+template<typename Loss>
+struct multiclass_model {
+  typedef multiclass_params params;
+
+  static std::string name() {
+      return std::string(Loss::name()) + "_ovr";
+  }
+
+  static uint outputs(const params& args) {
+      return args.outputs;
+  }
+
+  static inline bool check(const vector<fp_type>* w, const data_point& point, const params* args) {
+      const uint K = args->outputs;
+      fp_type* const dots = buffer(K);
+      vectors::dot_rows(w->data, point, K, dots);
+      uint best = 0;
+      FOR_N(k, K) {
+          if (dots[k] > dots[best]) best = k;
       }
+      return static_cast<int>(best) == args->class_of(point.label);
   }
-}
 
-#define MODEL_UPDATE svm::update
-#define MODEL_CHECK svm::check
-#define MODEL_PARAMS SVMParams
+  static inline void update(const data_point& point, vector<fp_type>* w, const fp_type step, params* args) {
+      const uint K = args->outputs;
+      fp_type* const e = buffer(K);
+      vectors::dot_rows(w->data, point, K, e);
+      step_rows(point, w, step, args->class_of(point.label), K, e, args);
+  }
 
+private:
+  static inline fp_type* buffer(const uint K) {
+      static thread_local std::vector<fp_type> dots;
+      if (unlikely(dots.size() < K)) dots.resize(K);
+      return dots.data();
+  }
+
+  // Turns the dot products into the steps e[k] in place and applies them.
+  static inline void step_rows(const data_point& point, vector<fp_type>* w, const fp_type step,
+                               const int label_class, const uint K, fp_type* const e, const RegularizationParams* args) {
+      FOR_N(k, K) {
+          e[k] = step * Loss::gradient(e[k], static_cast<int>(k) == label_class ? 1 : -1);
+      }
+      vectors::scale_add_shrink_rows(w->data, point, K, e, args->mu_over_degree.data, step);
+  }
+
+  static inline void step_rows(const data_point& point, vector<fp_type>* w, const fp_type step,
+                               const int label_class, const uint K, fp_type* const e, LazyRegularizationParams* args) {
+      const fp_type scale = args->thread_scale();
+      bool nonzero = false;
+      FOR_N(k, K) {
+          const fp_type gradient = Loss::gradient(e[k] * scale, static_cast<int>(k) == label_class ? 1 : -1);
+          nonzero |= gradient != 0;
+          e[k] = step * gradient / scale;
+      }
+      if (nonzero) {
+          vectors::scale_add_shrink_rows(w->data, point, K, e, nullptr, 0);
+      }
+      args->decay(step);
+  }
+};
+
+typedef linear_model<hinge_loss> svm_model;
+typedef linear_model<logistic_loss> logistic_model;
+typedef linear_model<squared_loss> least_squares_model;
+typedef multiclass_model<hinge_loss> svm_ovr_model;
+typedef multiclass_model<logistic_loss> logistic_ovr_model;
+typedef multiclass_model<squared_loss> least_squares_ovr_model;
+
+// Confusion counts of a binary classifier. Every thread counts its own slice, so the fields are plain.
 struct metric_summary {
-  std::atomic<uint> true_positive;
-  std::atomic<uint> true_negative;
-  std::atomic<uint> false_positive;
-  std::atomic<uint> false_negative;
+  uint true_positive;
+  uint true_negative;
+  uint false_positive;
+  uint false_negative;
 
   metric_summary() : true_positive(0), true_negative(0), false_positive(0), false_negative(0) {}
 
   metric_summary(uint tp, uint tn, uint fp, uint fn) : true_positive(tp), true_negative(tn), false_positive(fp), false_negative(fn) {}
 
-  metric_summary(const metric_summary& other)
-      : true_positive(other.true_positive.load()),
-        true_negative(other.true_negative.load()),
-        false_positive(other.false_positive.load()),
-        false_negative(other.false_negative.load()) {}
-
   fp_type to_score() const {
-      return (true_positive.load() + true_negative.load()) / static_cast<fp_type>(total());
+      return (true_positive + true_negative) / static_cast<fp_type>(total());
   }
 
   void plus(const metric_summary& x) {
-      true_positive.fetch_add(x.true_positive.load());
-      true_negative.fetch_add(x.true_negative.load());
-      false_positive.fetch_add(x.false_positive.load());
-      false_negative.fetch_add(x.false_negative.load());
+      true_positive += x.true_positive;
+      true_negative += x.true_negative;
+      false_positive += x.false_positive;
+      false_negative += x.false_negative;
   }
 
   uint total() const {
-      return true_positive.load() + true_negative.load() + false_positive.load() + false_negative.load();
+      return true_positive + true_negative + false_positive + false_negative;
   }
 };
 
-static metric_summary compute_metric(const dataset_local& dataset, const vector<fp_type>* w, const uint start, const uint end) {
+template<typename Model>
+static metric_summary compute_metric(const dataset_local& dataset, const vector<fp_type>* w, const typename Model::params* args,
+                                     const uint start, const uint end) {
     uint tp = 0, tn = 0, fp = 0, fn = 0;
     for (uint i = start; i < end; ++i) {
         const data_point point = dataset[i];
-        const bool correct = MODEL_CHECK(w, point);
-        const bool positive = point.label > 0;
+        const bool correct = Model::check(w, point, args);
+        const bool positive = binary_label(point.label) > 0;
         if (correct) {
             if (positive) tp++; else tn++;
         } else {
@@ -142,9 +535,26 @@ static metric_summary compute_metric(const dataset_local& dataset, const vector<
     return {tp, tn, fp, fn};
 }
 
-static metric_summary compute_metric(const dataset_local& dataset, const vector<fp_type>* w) {
+template<typename Model>
+static metric_summary compute_metric(const dataset_local& dataset, const vector<fp_type>* w, const typename Model::params* args) {
     const uint size = dataset.get_size();
-    return compute_metric(dataset, w, 0, size);
+    return compute_metric<Model>(dataset, w, args, 0, size);
+}
+
+// Metric over a dataset_stream, which can only be scanned sequentially.
+template<typename Model>
+static metric_summary compute_metric(const dataset_stream& dataset, const vector<fp_type>* w, const typename Model::params* args) {
+    uint tp = 0, tn = 0, fp = 0, fn = 0;
+    dataset.for_each([&](const data_point& point) {
+      const bool correct = Model::check(w, point, args);
+      const bool positive = binary_label(point.label) > 0;
+      if (correct) {
+          if (positive) tp++; else tn++;
+      } else {
+          if (positive) fn++; else fp++;
+      }
+    });
+    return {tp, tn, fp, fn};
 }
 
 #endif //PSGD_MODEL_H
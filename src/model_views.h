@@ -0,0 +1,102 @@
+//
+// Created by Maksim.Zuev on 17.10.2026.
+//
+
+#ifndef PSGD_MODEL_VIEWS_H
+#define PSGD_MODEL_VIEWS_H
+
+#include "types.h"
+#include "vectors.h"
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Views of one model vector that share all the pages except a few private ones.
+// The model lives in a memfd: every view maps the shared part of the file at the model offsets
+// and then maps its own copies of the private pages over them, so the update kernels see
+// an ordinary array. The file layout is [model pages][view 0 private pages][view 1 private pages]...
+class model_views {
+private:
+  const uint size;
+  const uint count;
+  const size_t page_size;
+  const uint pages;
+  const vector<uint> private_pages;
+  int fd = -1;
+  fp_type* master = nullptr;
+  vector<fp_type*> views;
+  vector<fp_type*> privates;
+
+  void* map(void* address, size_t length, size_t page, int flags) {
+      void* result = mmap(address, length, PROT_READ | PROT_WRITE, MAP_SHARED | flags, fd, page * page_size);
+      if (result == MAP_FAILED) throw std::runtime_error("Failed to map a model view.");
+      return result;
+  }
+
+public:
+  // Maps `count` views of a model of `size` values, each with its own copy of `private_pages`.
+  model_views(uint size, uint count, const vector<uint>& private_pages)
+      : size(size),
+        count(count),
+        page_size(sysconf(_SC_PAGESIZE)),
+        pages(static_cast<uint>((size * sizeof(fp_type) + page_size - 1) / page_size)),
+        private_pages(private_pages) {
+      fd = memfd_create("psgd_model", 0);
+      if (fd < 0) throw std::runtime_error("Failed to create a model file.");
+      const size_t hot = private_pages.size;
+      if (ftruncate(fd, (pages + count * hot) * page_size) != 0) throw std::runtime_error("Failed to size a model file.");
+
+      master = reinterpret_cast<fp_type*>(map(nullptr, pages * page_size, 0, 0));
+      views.init(count, nullptr);
+      privates.init(count, nullptr);
+      FOR_N(v, count) {
+          const size_t first_private = pages + v * hot;
+          char* const view = reinterpret_cast<char*>(map(nullptr, pages * page_size, 0, 0));
+          FOR_N(h, hot) {
+              map(view + private_pages[h] * page_size, page_size, first_private + h, MAP_FIXED);
+          }
+          views[v] = reinterpret_cast<fp_type*>(view);
+          if (hot > 0) privates[v] = reinterpret_cast<fp_type*>(map(nullptr, hot * page_size, first_private, 0));
+      }
+  }
+
+  model_views(const model_views&) = delete;
+
+  ~model_views() {
+      const size_t hot = private_pages.size;
+      FOR_N(v, count) {
+          munmap(views[v], pages * page_size);
+          if (privates[v]) munmap(privates[v], hot * page_size);
+      }
+      munmap(master, pages * page_size);
+      close(fd);
+  }
+
+  uint get_size() const {
+      return size;
+  }
+
+  uint private_count() const {
+      return private_pages.size;
+  }
+
+  uint page_values() const {
+      return static_cast<uint>(page_size / sizeof(fp_type));
+  }
+
+  // Model as seen by view `v`.
+  fp_type* view(uint v) {
+      return views[v];
+  }
+
+  // Shared copy of private page `h`, which no view maps.
+  fp_type* master_page(uint h) {
+      return master + static_cast<size_t>(private_pages[h]) * page_values();
+  }
+
+  fp_type* private_page(uint v, uint h) {
+      return privates[v] + static_cast<size_t>(h) * page_values();
+  }
+};
+
+#endif //PSGD_MODEL_VIEWS_H
@@ -10,6 +10,7 @@
 #include <chrono>
 #include <sstream>
 #include "experiment.h"
+#include "feature_order.h"
 
 
 typedef std::chrono::high_resolution_clock Time;
@@ -18,33 +19,69 @@ typedef std::chrono::duration<fp_type> fp_sec;
 struct experiment_configuration {
 private:
   std::unique_ptr<dataset> permuted_train{};
+  // Datasets with the features renumbered by first_touch_order.
+  std::unique_ptr<dataset> reordered_train{};
+  std::unique_ptr<dataset> reordered_test{};
+  std::unique_ptr<dataset> reordered_validate{};
+  // train() sharded between the nodes of the workers.
+  std::unique_ptr<dataset> sharded_train{};
 public:
   static bool verbose;
-
-  const dataset& train_dataset;
+  // Shard the train set between the nodes of the workers instead of training on replicas,
+  // the shards move to the next node every migration_period epochs (0 keeps them in place).
+  static bool shard_train;
+  static unsigned migration_period;
+  // Threads done with their blocks take the blocks of the others, see stealing().
+  static bool work_stealing;
+
+  // Exactly one of them is set, a train stream is read from disk chunk by chunk (see dataset_stream.h).
+  const dataset* const train_dataset;
+  const dataset_stream* const train_stream;
   const dataset& test_dataset;
   const dataset& validate_dataset;
   std::ostream& output;
 
   std::string algorithm;
+  std::string model = svm_model::name();
   unsigned test_repeats = 1;
   unsigned block_size = 512;
   unsigned threads = 1, cluster_size = 1, max_epochs = 100, update_delay = 64;
+  // Replica syncs between two node model exchanges of the Hierarchical algorithms.
+  unsigned node_delay = 8;
   fp_type target_score = 1, step_size = 0.5, step_decay = 0.8;
   fp_type mu = 1, tolerance = 0.01;
 
   experiment_configuration(const dataset& train_dataset,
                            const dataset& test_dataset,
                            const dataset& validate_dataset,
-                           std::ostream& output) : train_dataset(train_dataset), test_dataset(test_dataset), validate_dataset(validate_dataset), output(output) {}
+                           std::ostream& output)
+      : train_dataset(&train_dataset), train_stream(nullptr), test_dataset(test_dataset), validate_dataset(validate_dataset), output(output) {}
+
+  experiment_configuration(const dataset_stream& train_stream,
+                           const dataset& test_dataset,
+                           const dataset& validate_dataset,
+                           std::ostream& output)
+      : train_dataset(nullptr), train_stream(&train_stream), test_dataset(test_dataset), validate_dataset(validate_dataset), output(output) {}
 
   bool from_string(const std::string& command) {
       std::stringstream ss(command);
       std::string permutation_file;
       ss >> algorithm >> test_repeats >> threads >> cluster_size >> max_epochs >> update_delay >> target_score
          >> step_size >> step_decay >> block_size >> permutation_file;
-      if (!ss.fail() && permutation_file != "none") {
-          uint dataset_size = train_dataset.get_data(0).get_size();
+      if (ss.fail()) return false;
+      // Optional trailing model field: svm (default), logistic or least_squares,
+      // the _ovr suffix (e.g. svm_ovr) trains one-vs-rest over all the integer labels in a single pass.
+      // It may be followed by the node delay of the Hierarchical algorithms.
+      std::string model_name;
+      if (ss >> model_name) model = model_name;
+      unsigned node_delay_value;
+      if (ss >> node_delay_value) node_delay = node_delay_value;
+      if (train_stream && (permutation_file != "none" || placement() == model_placement::partitioned)) {
+          std::cerr << "Permutations and partitioned models need the train set in memory, not a stream" << std::endl;
+          return false;
+      }
+      if (permutation_file != "none") {
+          uint dataset_size = train_dataset->get_data(0).get_size();
           std::vector<uint> permutation = load_permutation(permutation_file, dataset_size);
           if (permutation.size() != dataset_size) {
               std::cerr << "Dataset size is " << dataset_size
@@ -57,9 +94,39 @@ public:
           FOR_N(i, permutation.size()) {
               inverse_permutation[permutation[i]] = i;
           }
-          permuted_train.reset(new dataset(train_dataset, inverse_permutation));
+          permuted_train.reset(new dataset(*train_dataset, inverse_permutation));
       }
-      return !ss.fail();
+      // HogWildHot packs the hot features onto the first pages, a streamed train set keeps its ids.
+      if (algorithm == "HogWildPartitionedReordered" || (algorithm == "HogWildHot" && !train_stream)) {
+          const feature_renumbering order = algorithm == "HogWildHot" ? hot_first_order(train().get_data(0), HOT_FEATURES)
+                                                                      : first_touch_order(train().get_data(0));
+          reordered_train.reset(new dataset(train(), order));
+          reordered_test.reset(new dataset(test_dataset, order));
+          if (&validate_dataset != &test_dataset) reordered_validate.reset(new dataset(validate_dataset, order));
+      }
+      if (shard_train && !train_stream) {
+          shard_weights shards;
+          shards.weights.assign(config.get_numa_count(), 0);
+          FOR_N(t, threads) {
+              shards.weights[config.get_node_for_thread(t)]++;
+          }
+          sharded_train.reset(new dataset(train(), shards));
+      }
+      return true;
+  }
+
+  const dataset& train() const {
+      if (reordered_train) return *reordered_train;
+      return permuted_train ? *permuted_train : *train_dataset;
+  }
+
+  const dataset& test() const {
+      return reordered_test ? *reordered_test : test_dataset;
+  }
+
+  const dataset& validate() const {
+      if (&validate_dataset == &test_dataset) return test();
+      return reordered_validate ? *reordered_validate : validate_dataset;
   }
 
   template<typename T>
@@ -67,26 +134,42 @@ public:
       throw std::runtime_error("This function must not be called!");
   }
 
-  template<typename T>
+  template<typename Model, typename T>
   void run_experiments_internal() {
-      const dataset& train = permuted_train ? *permuted_train : train_dataset;
+      if (train_stream) {
+          run_experiments_internal<Model, T>(*train_stream);
+      } else {
+          run_experiments_internal<Model, T>(train());
+      }
+  }
+
+  // Train is a dataset or a dataset_stream.
+  template<typename Model, typename T, typename Train>
+  void run_experiments_internal(const Train& train) {
+      const dataset& validate_dataset = validate();
+      const dataset& test_dataset = test();
       if (verbose) {
           std::cout << "Start experiments (" << test_repeats << ") with " << algorithm << " algorithm"
+                    << " model=" << model
                     << " threads=" << threads
                     << (algorithm == "HogWild" ? "" : " cluster_size=" + std::to_string(cluster_size))
                     << " target_score=" << target_score
                     << " step_size=" << step_size
                     << " step_decay=" << step_decay
                     << (algorithm == "HogWild" ? "" : " update_delay=" + std::to_string(update_delay))
+                    << (hierarchical() ? " node_delay=" + std::to_string(node_delay) : "")
                     << " block_size=" << block_size
                     << " permuted=" << (permuted_train ? 1 : 0)
+                    << (sharded_train ? " sharded=1 migration_period=" + std::to_string(migration_period) : "")
+                    << (train_stream ? " stream_chunks=" + std::to_string(train_stream->get_chunks()) : "")
                     << std::endl;
       }
 
       thread_pool tp(threads);
 
-      const uint features = train.get_features();
-      SVMParams svm_params(mu, &train);
+      typename Model::params model_params(mu, &train);
+      // Multi-output models keep a row of outputs per feature.
+      const uint model_size = train.get_features() * Model::outputs(model_params);
 
       sgd_params params{};
       params.max_epochs = max_epochs;
@@ -94,25 +177,36 @@ public:
       params.step_decay = step_decay;
       params.step = step_size;
       params.block_size = block_size;
+      params.migration_period = migration_period;
+      params.steal = stealing();
 
       fp_type total_time = 0;
       fp_type total_epochs = 0;
       fp_type total_epoch_time = 0;
       fp_type total_tests = 0;
+      fp_type total_idle = 0;
+      fp_type total_passes = 0;
 
       FOR_N(run, test_repeats) {
-          std::unique_ptr<T> scheme(create_scheme<T>(features, &svm_params));
+          std::unique_ptr<T> scheme(create_scheme<T>(model_size, &model_params));
 
           fp_type average_epochs;
+          std::vector<fp_type> idle;
           auto start = Time::now();
-          bool success = run_experiment<T>(train, validate_dataset, tp, &params, scheme.get(), average_epochs);
+          bool success = run_experiment<Model, T>(training_set(train), validate_dataset, tp, &params, scheme.get(), average_epochs, idle);
           auto end = Time::now();
 
-          fp_type train_score = compute_metric(train.get_data(0), scheme->get_model_vector(0)).to_score();
-          fp_type validate_score = compute_metric(validate_dataset.get_data(0), scheme->get_model_vector(0)).to_score();
-          fp_type test_score = compute_metric(test_dataset.get_data(0), scheme->get_model_vector(0)).to_score();
+          const auto* result_args = reinterpret_cast<typename Model::params*>(scheme->get_model_args(0));
+          fp_type train_score = train_metric<Model>(train, scheme->get_model_vector(0), result_args).to_score();
+          fp_type validate_score = compute_metric<Model>(validate_dataset.get_data(0), scheme->get_model_vector(0), result_args).to_score();
+          fp_type test_score = compute_metric<Model>(test_dataset.get_data(0), scheme->get_model_vector(0), result_args).to_score();
           fp_type time = static_cast<fp_sec>(end - start).count();
           fp_type epoch_time = time / average_epochs;
+          // Share of the time the threads waited for the slowest one at the epoch barriers.
+          fp_type idle_share = 0;
+          for (const fp_type thread_idle: idle) idle_share += thread_idle;
+          idle_share /= idle.size() * time;
+          const uint64_t passes = background_passes(scheme.get());
 
           if (verbose) {
               std::cout << std::fixed << std::setprecision(5) << std::setfill(' ')
@@ -121,7 +215,12 @@ public:
                         << " time=" << time
                         << " epochs=" << average_epochs
                         << " per_epoch=" << epoch_time
+                        << " idle=" << idle_share
+                        << (async_sync() ? " sync_passes=" + std::to_string(passes) : "")
                         << std::endl;
+              std::cout << "Idle seconds per thread:";
+              for (const fp_type thread_idle: idle) std::cout << ' ' << thread_idle;
+              std::cout << std::endl;
           }
 
           output
@@ -130,7 +229,8 @@ public:
               << average_epochs << ',' << epoch_time << ','
               << step_size << ',' << step_decay << ',' << update_delay << ','
               << target_score << ',' << block_size << ','
-              << (permuted_train ? 1 : 0)
+              << (permuted_train ? 1 : 0) << ','
+              << model
               << std::endl;
 
           if (!verbose) std::cout << (success ? '.' : '!') << std::flush;
@@ -139,18 +239,23 @@ public:
           total_time += time;
           total_epochs += average_epochs;
           total_epoch_time += epoch_time;
+          total_idle += idle_share;
+          total_passes += passes;
           total_tests++;
       }
 
       total_time /= total_tests;
       total_epochs /= total_tests;
       total_epoch_time /= total_tests;
+      total_idle /= total_tests;
+      total_passes /= total_tests;
       total_tests /= test_repeats;
 
 
       std::cout << (verbose ? "" : "\n")
                 << "Average results:"
                 << " algorithm=" << algorithm
+                << " model=" << model
                 << " threads=" << threads
                 << (algorithm == "HogWild" ? "" : " cluster_size=" + std::to_string(cluster_size))
                 << " block_size=" << block_size
@@ -161,22 +266,125 @@ public:
                 << " time=" << total_time
                 << " epochs=" << total_epochs
                 << " epoch_time=" << total_epoch_time
+                << " idle=" << total_idle;
+      if (async_sync()) std::cout << " sync_passes=" << total_passes;
+      std::cout << (work_stealing ? " stealing=1" : "")
                 << " permuted=" << (permuted_train ? 1 : 0)
                 << std::endl;
   }
 
   void run_experiments() {
-      if (algorithm == "HogWild") {
-          run_experiments_internal<hogwild_data_scheme>();
-      } else if (algorithm == "HogWild++") {
-          run_experiments_internal<hogwild_XX_data_scheme<SVMParams>>();
-      } else if (algorithm == "MyWild") {
-          run_experiments_internal<mywild_data_scheme<SVMParams>>();
+      if (model == svm_model::name()) {
+          run_model_experiments<svm_model>();
+      } else if (model == logistic_model::name()) {
+          run_model_experiments<logistic_model>();
+      } else if (model == least_squares_model::name()) {
+          run_model_experiments<least_squares_model>();
+      } else if (model == svm_ovr_model::name()) {
+          run_model_experiments<svm_ovr_model>();
+      } else if (model == logistic_ovr_model::name()) {
+          run_model_experiments<logistic_ovr_model>();
+      } else if (model == least_squares_ovr_model::name()) {
+          run_model_experiments<least_squares_ovr_model>();
+      } else {
+          std::cerr << "Unexpected model: " << model << std::endl;
+      }
+  }
+
+private:
+  // Set the workers train on: the shards if there are any.
+  const dataset& training_set(const dataset& train) const {
+      return sharded_train ? *sharded_train : train;
+  }
+
+  const dataset_stream& training_set(const dataset_stream& train) const {
+      return train;
+  }
+
+  // Passes of the background sync thread of the async schemes, compared with the syncs of the inline ones.
+  template<typename T>
+  static uint64_t background_passes(const T*) {
+      return 0;
+  }
+
+  template<typename P>
+  static uint64_t background_passes(const hogwild_XX_data_scheme<P>* scheme) {
+      return scheme->sync_passes();
+  }
+
+  template<typename P>
+  static uint64_t background_passes(const mywild_data_scheme<P>* scheme) {
+      return scheme->sync_passes();
+  }
+
+  template<typename Model>
+  static metric_summary train_metric(const dataset& train, const vector<fp_type>* w, const typename Model::params* args) {
+      return compute_metric<Model>(train.get_data(0), w, args);
+  }
+
+  template<typename Model>
+  static metric_summary train_metric(const dataset_stream& train, const vector<fp_type>* w, const typename Model::params* args) {
+      return compute_metric<Model>(train, w, args);
+  }
+
+  // Verbose runs show how much of the HogWildHot model the clusters keep private.
+  static void report_private_features(const uint private_features, const uint features) {
+      if (!verbose) return;
+      std::cout << "HogWildHot keeps " << private_features << " of " << features << " features private per cluster" << std::endl;
+  }
+
+  // HogWild and its placements share one model, so a thread may take blocks of any other thread.
+  // The replica schemes steal only inside a cluster, so that the data of the cluster still trains its replicas,
+  // and LocalSGD never steals: its all-reduce rounds need the same number of points on every thread.
+  steal_scope stealing() const {
+      if (!work_stealing || algorithm == "LocalSGD") return steal_scope::none;
+      return algorithm == "HogWild" || placement() != model_placement::local ? steal_scope::any : steal_scope::cluster;
+  }
+
+  // HogWild++Async and MyWildAsync sync the cluster models on a background thread.
+  bool async_sync() const {
+      return algorithm == "HogWild++Async" || algorithm == "MyWildAsync";
+  }
+
+  // HogWild with the model interleaved over the nodes of the workers or partitioned between them,
+  // HogWildPartitionedReordered also renumbers the features so that co-occurring ones share a node.
+  model_placement placement() const {
+      if (algorithm == "HogWildInterleaved") return model_placement::interleaved;
+      if (algorithm == "HogWildPartitioned" || algorithm == "HogWildPartitionedReordered") return model_placement::partitioned;
+      return model_placement::local;
+  }
+
+  // Hierarchical exchanges node models over a ring, HierarchicalButterfly over a butterfly.
+  bool hierarchical() const {
+      return algorithm == "Hierarchical" || algorithm == "HierarchicalButterfly";
+  }
+
+  template<typename Model>
+  void run_model_experiments() {
+      typedef typename Model::params params;
+      if (algorithm == "HogWild" || placement() != model_placement::local) {
+          run_experiments_internal<Model, hogwild_data_scheme>();
+      } else if (algorithm == "HogWild++" || algorithm == "HogWild++Async") {
+          run_experiments_internal<Model, hogwild_XX_data_scheme<params>>();
+      } else if (algorithm == "MyWild" || algorithm == "MyWildAsync") {
+          run_experiments_internal<Model, mywild_data_scheme<params>>();
+      } else if (hierarchical()) {
+          run_experiments_internal<Model, hierarchical_data_scheme<params>>();
+      } else if (algorithm == "LocalSGD") {
+          run_experiments_internal<Model, local_sgd_data_scheme<params>>();
+      } else if (algorithm == "HogWildHot") {
+#ifndef LAZY_REGULARIZATION
+          run_experiments_internal<Model, hot_hogwild_data_scheme<params>>();
+#else
+          std::cerr << "HogWildHot picks the hot features by their degrees, which the lazy regularisation does not compute:"
+                    << " build without -DLAZY_REGULARIZATION to run it" << std::endl;
+#endif
       } else {
           std::cerr << "Unexpected algorithm: " << algorithm << std::endl;
       }
   }
 
+
 private:
   static std::vector<uint> load_permutation(const std::string& path, uint size) {
       std::vector<uint> result;
@@ -197,24 +405,103 @@ private:
 };
 
 bool experiment_configuration::verbose = false;
+bool experiment_configuration::shard_train = false;
+unsigned experiment_configuration::migration_period = 0;
+bool experiment_configuration::work_stealing = false;
+
+template<>
+hogwild_data_scheme* experiment_configuration::create_scheme(uint size, void* model_args) {
+    const model_placement mode = placement();
+    if (mode == model_placement::local) return new hogwild_data_scheme(size, model_args);
+    const uint nodes = config.get_node_for_thread(threads - 1) + 1;
+    std::vector<uint> node_ends;
+    if (mode == model_placement::partitioned) {
+        const uint features = train().get_features();
+        node_ends = balanced_feature_ranges(train().get_data(0), nodes);
+        for (uint& end: node_ends) end = static_cast<uint>(static_cast<uint64_t>(end) * size / features);
+    } else {
+        node_ends.assign(nodes, size);
+    }
+    return new hogwild_data_scheme(size, model_args, mode, node_ends);
+}
+
+template<>
+hogwild_XX_data_scheme<regularization_params>* experiment_configuration::create_scheme(uint features, void* model_args) {
+    auto model_params = reinterpret_cast<regularization_params*>(model_args);
+    hogwild_XX_params params(threads, cluster_size, tolerance, update_delay, async_sync());
+    return new hogwild_XX_data_scheme<regularization_params>(features, model_params, params);
+}
+
+template<>
+mywild_data_scheme<regularization_params>* experiment_configuration::create_scheme(uint features, void* model_args) {
+    auto model_params = reinterpret_cast<regularization_params*>(model_args);
+    mywild_params params(threads, cluster_size, update_delay, async_sync());
+    return new mywild_data_scheme<regularization_params>(features, model_params, params);
+}
+
+template<>
+hogwild_XX_data_scheme<multiclass_params>* experiment_configuration::create_scheme(uint features, void* model_args) {
+    auto model_params = reinterpret_cast<multiclass_params*>(model_args);
+    hogwild_XX_params params(threads, cluster_size, tolerance, update_delay, async_sync());
+    return new hogwild_XX_data_scheme<multiclass_params>(features, model_params, params);
+}
+
+template<>
+mywild_data_scheme<multiclass_params>* experiment_configuration::create_scheme(uint features, void* model_args) {
+    auto model_params = reinterpret_cast<multiclass_params*>(model_args);
+    mywild_params params(threads, cluster_size, update_delay, async_sync());
+    return new mywild_data_scheme<multiclass_params>(features, model_params, params);
+}
+
+template<>
+hierarchical_data_scheme<regularization_params>* experiment_configuration::create_scheme(uint features, void* model_args) {
+    auto model_params = reinterpret_cast<regularization_params*>(model_args);
+    hierarchical_params params(threads, cluster_size, update_delay, node_delay, algorithm == "HierarchicalButterfly");
+    return new hierarchical_data_scheme<regularization_params>(features, model_params, params);
+}
+
+template<>
+hierarchical_data_scheme<multiclass_params>* experiment_configuration::create_scheme(uint features, void* model_args) {
+    auto model_params = reinterpret_cast<multiclass_params*>(model_args);
+    hierarchical_params params(threads, cluster_size, update_delay, node_delay, algorithm == "HierarchicalButterfly");
+    return new hierarchical_data_scheme<multiclass_params>(features, model_params, params);
+}
+
+template<>
+local_sgd_data_scheme<regularization_params>* experiment_configuration::create_scheme(uint features, void* model_args) {
+    auto model_params = reinterpret_cast<regularization_params*>(model_args);
+    local_sgd_params params(threads, cluster_size, update_delay);
+    return new local_sgd_data_scheme<regularization_params>(features, model_params, params);
+}
 
 template<>
-hogwild_data_scheme* experiment_configuration::create_scheme(uint features, void* model_args) {
-    return new hogwild_data_scheme(features, model_args);
+local_sgd_data_scheme<multiclass_params>* experiment_configuration::create_scheme(uint features, void* model_args) {
+    auto model_params = reinterpret_cast<multiclass_params*>(model_args);
+    local_sgd_params params(threads, cluster_size, update_delay);
+    return new local_sgd_data_scheme<multiclass_params>(features, model_params, params);
 }
 
+#ifndef LAZY_REGULARIZATION
+// Picks the hot features by their degrees, which the lazy regularisation does not compute.
 template<>
-hogwild_XX_data_scheme<SVMParams>* experiment_configuration::create_scheme(uint features, void* model_args) {
-    auto svm_params = reinterpret_cast<SVMParams*>(model_args);
-    hogwild_XX_params params(threads, cluster_size, tolerance, update_delay);
-    return new hogwild_XX_data_scheme<SVMParams>(features, svm_params, params);
+hot_hogwild_data_scheme<regularization_params>* experiment_configuration::create_scheme(uint features, void* model_args) {
+    auto model_params = reinterpret_cast<regularization_params*>(model_args);
+    hot_hogwild_params params(threads, cluster_size, update_delay);
+    auto* scheme = new hot_hogwild_data_scheme<regularization_params>(features, model_params, params);
+    report_private_features(scheme->private_features(), features / model_params->model_outputs());
+    return scheme;
 }
+#endif
 
+#ifndef LAZY_REGULARIZATION
 template<>
-mywild_data_scheme<SVMParams>* experiment_configuration::create_scheme(uint features, void* model_args) {
-    auto svm_params = reinterpret_cast<SVMParams*>(model_args);
-    mywild_params params(threads, cluster_size, update_delay);
-    return new mywild_data_scheme<SVMParams>(features, svm_params, params);
+hot_hogwild_data_scheme<multiclass_params>* experiment_configuration::create_scheme(uint features, void* model_args) {
+    auto model_params = reinterpret_cast<multiclass_params*>(model_args);
+    hot_hogwild_params params(threads, cluster_size, update_delay);
+    auto* scheme = new hot_hogwild_data_scheme<multiclass_params>(features, model_params, params);
+    report_private_features(scheme->private_features(), features / model_params->model_outputs());
+    return scheme;
 }
+#endif
 
 #endif //PSGD_RUN_CONFIGURATION_H
@@ -0,0 +1,522 @@
+//
+// Created by Maksim.Zuev on 17.10.2026.
+//
+
+#ifndef PSGD_SIMD_H
+#define PSGD_SIMD_H
+
+#include "types.h"
+#include "feature_value.h"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#if defined(__x86_64__) && !defined(PSGD_NO_SIMD)
+#define PSGD_SIMD
+#include <immintrin.h>
+#endif
+
+// Explicit SIMD kernels for sparse dot product and axpy over a dense model.
+// The instruction set is selected at runtime, the PSGD_SIMD environment variable
+// (scalar, avx2, avx512) may lower the detected level for benchmarking.
+namespace simd {
+  enum level {
+    SCALAR = 0,
+    AVX2 = 1,
+    AVX512 = 2,
+  };
+
+  inline const char* level_name(level l) {
+      switch (l) {
+          case AVX512:
+              return "avx512";
+          case AVX2:
+              return "avx2";
+          default:
+              return "scalar";
+      }
+  }
+
+  inline level detect() {
+      level result = SCALAR;
+#ifdef PSGD_SIMD
+      static_assert(std::is_same<fp_type, double>::value, "SIMD kernels expect a double precision model.");
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) result = AVX2;
+      if (__builtin_cpu_supports("avx512f")) result = AVX512;
+#endif
+      const char* env = getenv("PSGD_SIMD");
+      if (env != nullptr) {
+          level requested = SCALAR;
+          if (strcmp(env, "avx2") == 0) requested = AVX2;
+          if (strcmp(env, "avx512") == 0) requested = AVX512;
+          if (requested < result) result = requested;
+      }
+      return result;
+  }
+
+  static const level active = detect();
+
+#ifdef PSGD_SIMD
+#define PSGD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define PSGD_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+
+  // Loads 4 (AVX2) or 8 (AVX-512) feature values starting from i as doubles.
+  template<typename V>
+  struct values;
+
+  template<>
+  struct values<double> {
+    static const bool unit = false;
+
+    PSGD_TARGET_AVX2 static inline __m256d load4(const double* data, uint i) {
+        return _mm256_loadu_pd(data + i);
+    }
+
+    PSGD_TARGET_AVX512 static inline __m512d load8(const double* data, uint i) {
+        return _mm512_loadu_pd(data + i);
+    }
+  };
+
+  template<>
+  struct values<float> {
+    static const bool unit = false;
+
+    PSGD_TARGET_AVX2 static inline __m256d load4(const float* data, uint i) {
+        return _mm256_cvtps_pd(_mm_loadu_ps(data + i));
+    }
+
+    PSGD_TARGET_AVX512 static inline __m512d load8(const float* data, uint i) {
+        return _mm512_maskz_cvtps_pd(0xFF, _mm256_loadu_ps(data + i));
+    }
+  };
+
+  template<>
+  struct values<bfloat16> {
+    static const bool unit = false;
+
+    PSGD_TARGET_AVX2 static inline __m256d load4(const bfloat16* data, uint i) {
+        const __m128i bits = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data + i)));
+        return _mm256_cvtps_pd(_mm_castsi128_ps(_mm_slli_epi32(bits, 16)));
+    }
+
+    PSGD_TARGET_AVX512 static inline __m512d load8(const bfloat16* data, uint i) {
+        const __m256i bits = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+        return _mm512_maskz_cvtps_pd(0xFF, _mm256_castsi256_ps(_mm256_slli_epi32(bits, 16)));
+    }
+  };
+
+  template<>
+  struct values<binary_value> {
+    static const bool unit = true;
+
+    PSGD_TARGET_AVX2 static inline __m256d load4(const binary_value*, uint) {
+        return _mm256_set1_pd(1.0);
+    }
+
+    PSGD_TARGET_AVX512 static inline __m512d load8(const binary_value*, uint) {
+        return _mm512_set1_pd(1.0);
+    }
+  };
+
+  PSGD_TARGET_AVX2 inline __m128i load_indices4(const uint* indices, uint i) {
+      return _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i));
+  }
+
+  PSGD_TARGET_AVX512 inline __m256i load_indices8(const uint* indices, uint i) {
+      return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices + i));
+  }
+
+  // a[index[k]] for the 4 lanes. The masked form with an explicit zero source, as the plain gather
+  // reads an uninitialised source register (-Wmaybe-uninitialized).
+  PSGD_TARGET_AVX2 inline __m256d gather4(const fp_type* a, __m128i index) {
+      const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+      return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), a, index, all, 8);
+  }
+
+  PSGD_TARGET_AVX512 inline __m512d gather8(const fp_type* a, __m256i index) {
+      return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xFF, index, a, 8);
+  }
+
+  PSGD_TARGET_AVX2 inline fp_type horizontal_sum(__m256d x) {
+      const __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(x), _mm256_extractf128_pd(x, 1));
+      return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+  }
+
+  // _mm512_reduce_add_pd extracts the halves with an undefined source, the zero-masked extracts do not.
+  PSGD_TARGET_AVX512 inline fp_type horizontal_sum(__m512d x) {
+      return horizontal_sum(_mm256_add_pd(_mm512_maskz_extractf64x4_pd(0xF, x, 0), _mm512_maskz_extractf64x4_pd(0xF, x, 1)));
+  }
+
+  // Sum of a[indices[i]] * b[i], the model is gathered 4 coordinates at a time.
+  template<typename V>
+  PSGD_TARGET_AVX2 inline fp_type dot_avx2(const fp_type* const __restrict__ a,
+                                           const uint* const __restrict__ indices,
+                                           const V* const __restrict__ b,
+                                           const uint size) {
+      __m256d acc0 = _mm256_setzero_pd();
+      __m256d acc1 = _mm256_setzero_pd();
+      uint i = 0;
+      for (; i + 8 <= size; i += 8) {
+          const __m256d a0 = gather4(a, load_indices4(indices, i));
+          const __m256d a1 = gather4(a, load_indices4(indices, i + 4));
+          if (values<V>::unit) {
+              acc0 = _mm256_add_pd(acc0, a0);
+              acc1 = _mm256_add_pd(acc1, a1);
+          } else {
+              acc0 = _mm256_fmadd_pd(a0, values<V>::load4(b, i), acc0);
+              acc1 = _mm256_fmadd_pd(a1, values<V>::load4(b, i + 4), acc1);
+          }
+      }
+      if (i + 4 <= size) {
+          const __m256d a0 = gather4(a, load_indices4(indices, i));
+          acc0 = values<V>::unit ? _mm256_add_pd(acc0, a0) : _mm256_fmadd_pd(a0, values<V>::load4(b, i), acc0);
+          i += 4;
+      }
+      fp_type result = horizontal_sum(_mm256_add_pd(acc0, acc1));
+      for (; i < size; ++i) {
+          result += a[indices[i]] * value_traits<V>::get(b, i);
+      }
+      return result;
+  }
+
+  // a[indices[i]] += s * b[i]. AVX2 has no scatter, so the updated lanes are stored one by one.
+  template<typename V>
+  PSGD_TARGET_AVX2 inline void scale_and_add_avx2(fp_type* const __restrict__ a,
+                                                  const uint* const __restrict__ indices,
+                                                  const V* const __restrict__ b,
+                                                  const uint size,
+                                                  const fp_type s) {
+      const __m256d scale = _mm256_set1_pd(s);
+      alignas(32) fp_type updated[4];
+      uint i = 0;
+      for (; i + 4 <= size; i += 4) {
+          const __m256d old = gather4(a, load_indices4(indices, i));
+          const __m256d result = values<V>::unit ? _mm256_add_pd(old, scale)
+                                                 : _mm256_fmadd_pd(scale, values<V>::load4(b, i), old);
+          _mm256_store_pd(updated, result);
+          a[indices[i]] = updated[0];
+          a[indices[i + 1]] = updated[1];
+          a[indices[i + 2]] = updated[2];
+          a[indices[i + 3]] = updated[3];
+      }
+      for (; i < size; ++i) {
+          a[indices[i]] += s * value_traits<V>::get(b, i);
+      }
+  }
+
+  template<typename V>
+  PSGD_TARGET_AVX512 inline fp_type dot_avx512(const fp_type* const __restrict__ a,
+                                               const uint* const __restrict__ indices,
+                                               const V* const __restrict__ b,
+                                               const uint size) {
+      __m512d acc = _mm512_setzero_pd();
+      uint i = 0;
+      for (; i + 8 <= size; i += 8) {
+          const __m512d a0 = gather8(a, load_indices8(indices, i));
+          acc = values<V>::unit ? _mm512_add_pd(acc, a0) : _mm512_fmadd_pd(a0, values<V>::load8(b, i), acc);
+      }
+      fp_type result = horizontal_sum(acc);
+      for (; i < size; ++i) {
+          result += a[indices[i]] * value_traits<V>::get(b, i);
+      }
+      return result;
+  }
+
+  // Indices of a point are strictly increasing, so a scatter never writes one coordinate twice.
+  template<typename V>
+  PSGD_TARGET_AVX512 inline void scale_and_add_avx512(fp_type* const __restrict__ a,
+                                                      const uint* const __restrict__ indices,
+                                                      const V* const __restrict__ b,
+                                                      const uint size,
+                                                      const fp_type s) {
+      const __m512d scale = _mm512_set1_pd(s);
+      uint i = 0;
+      for (; i + 8 <= size; i += 8) {
+          const __m256i index = load_indices8(indices, i);
+          const __m512d old = gather8(a, index);
+          const __m512d result = values<V>::unit ? _mm512_add_pd(old, scale)
+                                                 : _mm512_fmadd_pd(scale, values<V>::load8(b, i), old);
+          _mm512_i32scatter_pd(a, index, result, 8);
+      }
+      for (; i < size; ++i) {
+          a[indices[i]] += s * value_traits<V>::get(b, i);
+      }
+  }
+
+  // a[j] = (a[j] + s * b[i]) * (1 - step * c[j]) for j = indices[i], one gather and one store per coordinate.
+  template<typename V>
+  PSGD_TARGET_AVX2 inline void scale_add_shrink_avx2(fp_type* const __restrict__ a,
+                                                     const uint* const __restrict__ indices,
+                                                     const V* const __restrict__ b,
+                                                     const uint size,
+                                                     const fp_type s,
+                                                     const fp_type* const __restrict__ c,
+                                                     const fp_type step) {
+      const __m256d scale = _mm256_set1_pd(s);
+      const __m256d neg_step = _mm256_set1_pd(-step);
+      const __m256d one = _mm256_set1_pd(1.0);
+      alignas(32) fp_type updated[4];
+      uint i = 0;
+      for (; i + 4 <= size; i += 4) {
+          const __m128i index = load_indices4(indices, i);
+          const __m256d old = gather4(a, index);
+          const __m256d shrink = _mm256_fmadd_pd(neg_step, gather4(c, index), one);
+          const __m256d added = values<V>::unit ? _mm256_add_pd(old, scale)
+                                                : _mm256_fmadd_pd(scale, values<V>::load4(b, i), old);
+          _mm256_store_pd(updated, _mm256_mul_pd(added, shrink));
+          a[indices[i]] = updated[0];
+          a[indices[i + 1]] = updated[1];
+          a[indices[i + 2]] = updated[2];
+          a[indices[i + 3]] = updated[3];
+      }
+      for (; i < size; ++i) {
+          const uint j = indices[i];
+          a[j] = (a[j] + s * value_traits<V>::get(b, i)) * (1 - step * c[j]);
+      }
+  }
+
+  template<typename V>
+  PSGD_TARGET_AVX512 inline void scale_add_shrink_avx512(fp_type* const __restrict__ a,
+                                                         const uint* const __restrict__ indices,
+                                                         const V* const __restrict__ b,
+                                                         const uint size,
+                                                         const fp_type s,
+                                                         const fp_type* const __restrict__ c,
+                                                         const fp_type step) {
+      const __m512d scale = _mm512_set1_pd(s);
+      const __m512d neg_step = _mm512_set1_pd(-step);
+      const __m512d one = _mm512_set1_pd(1.0);
+      uint i = 0;
+      for (; i + 8 <= size; i += 8) {
+          const __m256i index = load_indices8(indices, i);
+          const __m512d old = gather8(a, index);
+          const __m512d shrink = _mm512_fmadd_pd(neg_step, gather8(c, index), one);
+          const __m512d added = values<V>::unit ? _mm512_add_pd(old, scale)
+                                                : _mm512_fmadd_pd(scale, values<V>::load8(b, i), old);
+          _mm512_i32scatter_pd(a, index, _mm512_mul_pd(added, shrink), 8);
+      }
+      for (; i < size; ++i) {
+          const uint j = indices[i];
+          a[j] = (a[j] + s * value_traits<V>::get(b, i)) * (1 - step * c[j]);
+      }
+  }
+
+  // Multi-output kernels over a row-major features x K model, row j starts at a + j * K.
+  // Rows are contiguous, so every nonzero is one broadcast and K / width plain loads.
+
+  // out[k] = sum of b[i] * a[indices[i] * K + k].
+  template<typename V>
+  PSGD_TARGET_AVX2 inline void dot_rows_avx2(const fp_type* const __restrict__ a,
+                                             const uint* const __restrict__ indices,
+                                             const V* const __restrict__ b,
+                                             const uint size,
+                                             const uint K,
+                                             fp_type* const __restrict__ out) {
+      std::fill(out, out + K, 0);
+      FOR_N(i, size) {
+          const fp_type* const row = a + static_cast<size_t>(indices[i]) * K;
+          const fp_type x = value_traits<V>::get(b, i);
+          const __m256d xs = _mm256_set1_pd(x);
+          uint k = 0;
+          for (; k + 4 <= K; k += 4) {
+              _mm256_storeu_pd(out + k, _mm256_fmadd_pd(_mm256_loadu_pd(row + k), xs, _mm256_loadu_pd(out + k)));
+          }
+          for (; k < K; ++k) {
+              out[k] += row[k] * x;
+          }
+      }
+  }
+
+  // a[j * K + k] = (a[j * K + k] + e[k] * b[i]) * (1 - step * c[j]) for j = indices[i], c may be null.
+  template<typename V>
+  PSGD_TARGET_AVX2 inline void scale_add_shrink_rows_avx2(fp_type* const __restrict__ a,
+                                                          const uint* const __restrict__ indices,
+                                                          const V* const __restrict__ b,
+                                                          const uint size,
+                                                          const uint K,
+                                                          const fp_type* const __restrict__ e,
+                                                          const fp_type* const __restrict__ c,
+                                                          const fp_type step) {
+      FOR_N(i, size) {
+          const uint j = indices[i];
+          fp_type* const row = a + static_cast<size_t>(j) * K;
+          const fp_type x = value_traits<V>::get(b, i);
+          const fp_type shrink = c == nullptr ? 1 : 1 - step * c[j];
+          const __m256d xs = _mm256_set1_pd(x);
+          const __m256d shrinks = _mm256_set1_pd(shrink);
+          uint k = 0;
+          for (; k + 4 <= K; k += 4) {
+              const __m256d added = _mm256_fmadd_pd(_mm256_loadu_pd(e + k), xs, _mm256_loadu_pd(row + k));
+              _mm256_storeu_pd(row + k, _mm256_mul_pd(added, shrinks));
+          }
+          for (; k < K; ++k) {
+              row[k] = (row[k] + e[k] * x) * shrink;
+          }
+      }
+  }
+
+  // The tail of a row is handled with masked loads and stores.
+  template<typename V>
+  PSGD_TARGET_AVX512 inline void dot_rows_avx512(const fp_type* const __restrict__ a,
+                                                 const uint* const __restrict__ indices,
+                                                 const V* const __restrict__ b,
+                                                 const uint size,
+                                                 const uint K,
+                                                 fp_type* const __restrict__ out) {
+      std::fill(out, out + K, 0);
+      const uint full = K / 8 * 8;
+      const __mmask8 tail = static_cast<__mmask8>((1u << (K - full)) - 1);
+      FOR_N(i, size) {
+          const fp_type* const row = a + static_cast<size_t>(indices[i]) * K;
+          const __m512d xs = _mm512_set1_pd(value_traits<V>::get(b, i));
+          for (uint k = 0; k < full; k += 8) {
+              _mm512_storeu_pd(out + k, _mm512_fmadd_pd(_mm512_loadu_pd(row + k), xs, _mm512_loadu_pd(out + k)));
+          }
+          if (tail) {
+              const __m512d sum = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(tail, row + full), xs, _mm512_maskz_loadu_pd(tail, out + full));
+              _mm512_mask_storeu_pd(out + full, tail, sum);
+          }
+      }
+  }
+
+  template<typename V>
+  PSGD_TARGET_AVX512 inline void scale_add_shrink_rows_avx512(fp_type* const __restrict__ a,
+                                                              const uint* const __restrict__ indices,
+                                                              const V* const __restrict__ b,
+                                                              const uint size,
+                                                              const uint K,
+                                                              const fp_type* const __restrict__ e,
+                                                              const fp_type* const __restrict__ c,
+                                                              const fp_type step) {
+      const uint full = K / 8 * 8;
+      const __mmask8 tail = static_cast<__mmask8>((1u << (K - full)) - 1);
+      FOR_N(i, size) {
+          const uint j = indices[i];
+          fp_type* const row = a + static_cast<size_t>(j) * K;
+          const __m512d xs = _mm512_set1_pd(value_traits<V>::get(b, i));
+          const __m512d shrinks = _mm512_set1_pd(c == nullptr ? 1 : 1 - step * c[j]);
+          for (uint k = 0; k < full; k += 8) {
+              const __m512d added = _mm512_fmadd_pd(_mm512_loadu_pd(e + k), xs, _mm512_loadu_pd(row + k));
+              _mm512_storeu_pd(row + k, _mm512_mul_pd(added, shrinks));
+          }
+          if (tail) {
+              const __m512d added = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(tail, e + full), xs, _mm512_maskz_loadu_pd(tail, row + full));
+              _mm512_mask_storeu_pd(row + full, tail, _mm512_mul_pd(added, shrinks));
+          }
+      }
+  }
+
+  // Model sync kernels of HogWild++ and MyWild, see sync_hogwild_XX and sync_mywild in data_scheme.h.
+  // They process [i, size) while at least a full register is left and return the first unprocessed index.
+  // HogWild++ writes only the lanes of the next model over the tolerance, the rest of them may be updated
+  // by the other cluster meanwhile, so the masked store stays and only MyWild streams.
+  PSGD_TARGET_AVX2 inline uint sync_hogwild_XX_avx2(fp_type* const __restrict__ cur_w,
+                                                    fp_type* const __restrict__ next_w,
+                                                    fp_type* const __restrict__ old_w,
+                                                    uint i,
+                                                    const uint size,
+                                                    const fp_type step,
+                                                    const fp_type beta,
+                                                    const fp_type lambda,
+                                                    const fp_type tolerance) {
+      const __m256d v_step = _mm256_set1_pd(step);
+      const __m256d v_beta = _mm256_set1_pd(beta);
+      const __m256d v_lambda = _mm256_set1_pd(lambda);
+      const __m256d v_keep = _mm256_set1_pd(1 - lambda);
+      const __m256d v_far = _mm256_set1_pd(beta + lambda - 1);
+      const __m256d v_tolerance = _mm256_set1_pd(tolerance);
+      const __m256d v_sign = _mm256_set1_pd(-0.0);
+      for (; i + 4 <= size; i += 4) {
+          const __m256d wi = _mm256_loadu_pd(cur_w + i);
+          const __m256d next_i = _mm256_loadu_pd(next_w + i);
+          const __m256d delta = _mm256_mul_pd(_mm256_sub_pd(wi, _mm256_loadu_pd(old_w + i)), v_step);
+          const __m256d far = _mm256_cmp_pd(_mm256_andnot_pd(v_sign, delta), v_tolerance, _CMP_GT_OQ);
+          const __m256d coef = _mm256_blendv_pd(v_lambda, v_far, far);
+          const __m256d new_wi = _mm256_fmadd_pd(coef, delta, _mm256_fmadd_pd(next_i, v_lambda, _mm256_mul_pd(wi, v_keep)));
+          _mm256_storeu_pd(cur_w + i, new_wi);
+          _mm256_storeu_pd(old_w + i, _mm256_blendv_pd(_mm256_sub_pd(new_wi, delta), new_wi, far));
+          const __m256d next_new = _mm256_fmadd_pd(v_beta, delta, next_i);
+          _mm256_maskstore_pd(next_w + i, _mm256_castpd_si256(far), next_new);
+      }
+      return i;
+  }
+
+  // With Stream the next model is written with non-temporal stores, next_w + i must be aligned to the register size.
+  template<bool Stream>
+  PSGD_TARGET_AVX2 inline uint sync_mywild_avx2(fp_type* const __restrict__ cur_w,
+                                                fp_type* const __restrict__ next_w,
+                                                uint i,
+                                                const uint size) {
+      const __m256d half = _mm256_set1_pd(0.5);
+      for (; i + 4 <= size; i += 4) {
+          const __m256d wi = _mm256_loadu_pd(cur_w + i);
+          const __m256d next_i = _mm256_loadu_pd(next_w + i);
+          const __m256d new_wi = _mm256_mul_pd(_mm256_add_pd(wi, next_i), half);
+          _mm256_storeu_pd(cur_w + i, _mm256_add_pd(_mm256_sub_pd(new_wi, wi), wi));
+          const __m256d next_new = _mm256_add_pd(_mm256_sub_pd(new_wi, next_i), next_i);
+          if (Stream) {
+              _mm256_stream_pd(next_w + i, next_new);
+          } else {
+              _mm256_storeu_pd(next_w + i, next_new);
+          }
+      }
+      return i;
+  }
+
+  // Only the lanes over the tolerance are written to the next model, as in the scalar loop.
+  PSGD_TARGET_AVX512 inline uint sync_hogwild_XX_avx512(fp_type* const __restrict__ cur_w,
+                                                        fp_type* const __restrict__ next_w,
+                                                        fp_type* const __restrict__ old_w,
+                                                        uint i,
+                                                        const uint size,
+                                                        const fp_type step,
+                                                        const fp_type beta,
+                                                        const fp_type lambda,
+                                                        const fp_type tolerance) {
+      const __m512d v_step = _mm512_set1_pd(step);
+      const __m512d v_beta = _mm512_set1_pd(beta);
+      const __m512d v_lambda = _mm512_set1_pd(lambda);
+      const __m512d v_keep = _mm512_set1_pd(1 - lambda);
+      const __m512d v_far = _mm512_set1_pd(beta + lambda - 1);
+      const __m512d v_tolerance = _mm512_set1_pd(tolerance);
+      for (; i + 8 <= size; i += 8) {
+          const __m512d wi = _mm512_loadu_pd(cur_w + i);
+          const __m512d next_i = _mm512_loadu_pd(next_w + i);
+          const __m512d delta = _mm512_mul_pd(_mm512_sub_pd(wi, _mm512_loadu_pd(old_w + i)), v_step);
+          const __mmask8 far = _mm512_cmp_pd_mask(_mm512_abs_pd(delta), v_tolerance, _CMP_GT_OQ);
+          const __m512d coef = _mm512_mask_blend_pd(far, v_lambda, v_far);
+          const __m512d new_wi = _mm512_fmadd_pd(coef, delta, _mm512_fmadd_pd(next_i, v_lambda, _mm512_mul_pd(wi, v_keep)));
+          _mm512_storeu_pd(cur_w + i, new_wi);
+          _mm512_storeu_pd(old_w + i, _mm512_mask_blend_pd(far, _mm512_sub_pd(new_wi, delta), new_wi));
+          const __m512d next_new = _mm512_fmadd_pd(v_beta, delta, next_i);
+          _mm512_mask_storeu_pd(next_w + i, far, next_new);
+      }
+      return i;
+  }
+
+  template<bool Stream>
+  PSGD_TARGET_AVX512 inline uint sync_mywild_avx512(fp_type* const __restrict__ cur_w,
+                                                    fp_type* const __restrict__ next_w,
+                                                    uint i,
+                                                    const uint size) {
+      const __m512d half = _mm512_set1_pd(0.5);
+      for (; i + 8 <= size; i += 8) {
+          const __m512d wi = _mm512_loadu_pd(cur_w + i);
+          const __m512d next_i = _mm512_loadu_pd(next_w + i);
+          const __m512d new_wi = _mm512_mul_pd(_mm512_add_pd(wi, next_i), half);
+          _mm512_storeu_pd(cur_w + i, _mm512_add_pd(_mm512_sub_pd(new_wi, wi), wi));
+          const __m512d next_new = _mm512_add_pd(_mm512_sub_pd(new_wi, next_i), next_i);
+          if (Stream) {
+              _mm512_stream_pd(next_w + i, next_new);
+          } else {
+              _mm512_storeu_pd(next_w + i, next_new);
+          }
+      }
+      return i;
+  }
+#endif
+}
+
+#endif //PSGD_SIMD_H
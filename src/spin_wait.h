@@ -0,0 +1,118 @@
+//
+// Created by Maksim.Zuev on 17.10.2026.
+//
+
+#ifndef PSGD_SPIN_WAIT_H
+#define PSGD_SPIN_WAIT_H
+
+#include "types.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Pauses a waiter spins before it sleeps in the kernel, e.g. -DBARRIER_SPIN_BUDGET=1000000.
+#ifndef BARRIER_SPIN_BUDGET
+#define BARRIER_SPIN_BUDGET 65536
+#endif
+// Longest run of pauses between two polls of a wait_word.
+#define SPIN_MAX_BACKOFF 64u
+
+static const uint64_t SPIN_FOREVER = UINT64_MAX;
+
+static inline void spin_pause() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+// A word the waiters poll until it changes: exponential backoff first, a futex after the spin budget.
+// The waker changes the value with set or add, which wake the sleepers.
+struct wait_word {
+  std::atomic<uint> value;
+  std::atomic<uint> sleepers;
+
+  wait_word() : value(0), sleepers(0) {}
+
+  // Returns once the value differs from `old`, acquires the writes before the change.
+  void wait(const uint old, const uint64_t spin_budget = BARRIER_SPIN_BUDGET) {
+      uint64_t spins = 0;
+      uint backoff = 1;
+      while (value.load(std::memory_order_acquire) == old) {
+          if (spins >= spin_budget) {
+              sleep(old);
+              continue;
+          }
+          FOR_N(i, backoff) {
+              spin_pause();
+          }
+          spins += backoff;
+          backoff = std::min(backoff * 2, SPIN_MAX_BACKOFF);
+      }
+  }
+
+  // Publishes a new value, the writes before it become visible to the waiters.
+  void set(const uint next) {
+      value.store(next, std::memory_order_seq_cst);
+      if (sleepers.load(std::memory_order_seq_cst) > 0) notify_all();
+  }
+
+  // Adds to the value instead, for several wakers at once.
+  void add(const uint n) {
+      value.fetch_add(n, std::memory_order_seq_cst);
+      if (sleepers.load(std::memory_order_seq_cst) > 0) notify_all();
+  }
+
+private:
+  void sleep(const uint old) {
+      sleepers.fetch_add(1, std::memory_order_seq_cst);
+#ifdef __linux__
+      // Returns at once if the value has changed since the check.
+      syscall(SYS_futex, reinterpret_cast<uint*>(&value), FUTEX_WAIT_PRIVATE, old, nullptr, nullptr, 0);
+#else
+      (void) old;
+      std::this_thread::yield();
+#endif
+      sleepers.fetch_sub(1, std::memory_order_seq_cst);
+  }
+
+  void notify_all() {
+#ifdef __linux__
+      syscall(SYS_futex, reinterpret_cast<uint*>(&value), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+  }
+};
+
+// Test-and-test-and-set lock for short critical sections: a waiter polls the word with backoff
+// and tries the exchange only once it reads the lock free, so the line is not written while it is held.
+struct spin_lock {
+  std::atomic<bool> locked;
+
+  spin_lock() : locked(false) {}
+
+  void lock() {
+      uint backoff = 1;
+      while (locked.load(std::memory_order_relaxed) || locked.exchange(true, std::memory_order_acquire)) {
+          FOR_N(i, backoff) {
+              spin_pause();
+          }
+          backoff = std::min(backoff * 2, SPIN_MAX_BACKOFF);
+      }
+  }
+
+  void unlock() {
+      locked.store(false, std::memory_order_release);
+  }
+};
+
+#endif //PSGD_SPIN_WAIT_H
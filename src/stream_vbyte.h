@@ -0,0 +1,118 @@
+//
+// Created by Maksim.Zuev on 17.10.2026.
+//
+
+#ifndef PSGD_STREAM_VBYTE_H
+#define PSGD_STREAM_VBYTE_H
+
+#include "types.h"
+#include <cstdint>
+#include <cstring>
+
+#ifdef __SSSE3__
+#include <immintrin.h>
+#endif
+
+// Delta + StreamVByte coding of strictly increasing feature indices.
+// A list of n indices is stored as ceil(n / 4) control bytes followed by the data bytes.
+// Every control byte describes 4 deltas with 2 bits each (the number of data bytes minus one),
+// the data bytes of a delta are stored little-endian.
+// Decoding may read up to DECODE_PADDING bytes after the end of the list.
+namespace stream_vbyte {
+  const uint DECODE_PADDING = 16;
+
+  inline uint value_bytes(const uint delta) {
+      return delta < (1u << 8) ? 1 : delta < (1u << 16) ? 2 : delta < (1u << 24) ? 3 : 4;
+  }
+
+  // Size of the encoded list of `count` values which data bytes sum up to `data_bytes`.
+  inline uint64_t encoded_size(const uint count, const uint64_t data_bytes) {
+      return (count + 3) / 4 + data_bytes;
+  }
+
+  inline uint64_t encode(const uint* const indices, const uint count, uint8_t* const out) {
+      uint8_t* control = out;
+      uint8_t* data = out + (count + 3) / 4;
+      uint previous = 0;
+      FOR_N(i, count) {
+          const uint delta = indices[i] - previous;
+          previous = indices[i];
+          const uint bytes = value_bytes(delta);
+          if ((i & 3) == 0) *control = 0;
+          *control |= (bytes - 1) << (2 * (i & 3));
+          if ((i & 3) == 3) control++;
+          FOR_N(b, bytes) {
+              *data++ = static_cast<uint8_t>(delta >> (8 * b));
+          }
+      }
+      return data - out;
+  }
+
+  inline void decode_scalar(const uint8_t* const in, const uint count, uint* const out) {
+      const uint8_t* control = in;
+      const uint8_t* data = in + (count + 3) / 4;
+      uint previous = 0;
+      FOR_N(i, count) {
+          const uint bytes = ((control[i / 4] >> (2 * (i & 3))) & 3) + 1;
+          uint delta = 0;
+          FOR_N(b, bytes) {
+              delta |= static_cast<uint>(data[b]) << (8 * b);
+          }
+          data += bytes;
+          previous += delta;
+          out[i] = previous;
+      }
+  }
+
+#ifdef __SSSE3__
+  struct decode_tables {
+    alignas(16) uint8_t shuffle[256][16];
+    uint8_t length[256];
+
+    decode_tables() {
+        FOR_N(control, 256) {
+            uint offset = 0;
+            FOR_N(value, 4) {
+                const uint bytes = ((control >> (2 * value)) & 3) + 1;
+                FOR_N(b, 4) {
+                    shuffle[control][4 * value + b] = b < bytes ? offset + b : 0xff;
+                }
+                offset += bytes;
+            }
+            length[control] = offset;
+        }
+    }
+  };
+
+  inline const decode_tables& get_decode_tables() {
+      static const decode_tables tables;
+      return tables;
+  }
+
+  // Decodes 4 deltas per pshufb and turns them into indices with an in-register prefix sum.
+  // `out` must have room for count rounded up to a multiple of 4.
+  inline void decode(const uint8_t* const in, const uint count, uint* const out) {
+      const decode_tables& tables = get_decode_tables();
+      const uint8_t* control = in;
+      const uint8_t* data = in + (count + 3) / 4;
+      __m128i previous = _mm_setzero_si128();
+      for (uint i = 0; i < count; i += 4) {
+          const uint8_t c = *control++;
+          const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(tables.shuffle[c]));
+          __m128i deltas = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), mask);
+          data += tables.length[c];
+          deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 4));
+          deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 8));
+          const __m128i values = _mm_add_epi32(deltas, previous);
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), values);
+          previous = _mm_shuffle_epi32(values, 0xff);
+      }
+  }
+#else
+  inline void decode(const uint8_t* const in, const uint count, uint* const out) {
+      decode_scalar(in, count, out);
+  }
+#endif
+}
+
+#endif //PSGD_STREAM_VBYTE_H
@@ -12,12 +12,46 @@ int main(int argc, char** argv) {
                   << "2) test dataset path\n"
                   << "3) validate dataset path\n"
                   << "4) output CSV file path\n"
+                  << "5) experiments file path (stdin by default)\n"
+                  << "6) options: -v for verbose output, --stream[=<points per chunk>] to read the train set\n"
+                  << "   from disk chunk by chunk instead of loading it (datasets larger than RAM),\n"
+                  << "   --shard[=<epochs>] to shard the train set between the nodes of the workers instead of\n"
+                  << "   replicating it on every node, the shards move to the next node every <epochs> epochs,\n"
+                  << "   --steal to let the threads done with their blocks take the blocks of the others\n"
                   << std::endl;
         exit(1);
     }
     std::string train(argv[1]), test(argv[2]), validate(argv[3]), output(argv[4]);
+    bool verbose = false;
+    uint stream_chunk_points = 0;
+    for (int i = 6; i < argc; ++i) {
+        if (strcmp("-v", argv[i]) == 0) {
+            verbose = true;
+        } else if (strcmp("--stream", argv[i]) == 0) {
+            stream_chunk_points = STREAM_CHUNK_POINTS;
+        } else if (strncmp("--stream=", argv[i], 9) == 0) {
+            stream_chunk_points = std::max(1, atoi(argv[i] + 9));
+        } else if (strcmp("--steal", argv[i]) == 0) {
+            experiment_configuration::work_stealing = true;
+        } else if (strcmp("--shard", argv[i]) == 0) {
+            experiment_configuration::shard_train = true;
+        } else if (strncmp("--shard=", argv[i], 8) == 0) {
+            experiment_configuration::shard_train = true;
+            experiment_configuration::migration_period = std::max(0, atoi(argv[i] + 8));
+        } else {
+            std::cerr << "Unexpected option " << argv[i] << std::endl;
+            exit(1);
+        }
+    }
     const uint numa_nodes = config.get_numa_count();
-    dataset train_dataset(numa_nodes, train);
+    std::unique_ptr<dataset> train_dataset;
+    std::unique_ptr<dataset_stream> train_stream;
+    if (stream_chunk_points > 0) {
+        train_stream.reset(new dataset_stream(train, stream_chunk_points));
+    } else {
+        // Shards are made per experiment from a single copy, which is a file mapping once the cache exists.
+        train_dataset.reset(new dataset(experiment_configuration::shard_train ? 1 : numa_nodes, train));
+    }
     std::shared_ptr<dataset> test_dataset = std::make_shared<dataset>(numa_nodes, test);
     std::shared_ptr<dataset> validate_dataset = test == validate ? test_dataset : std::make_shared<dataset>(numa_nodes, validate);
 
@@ -44,11 +78,10 @@ int main(int argc, char** argv) {
     }
 
 
-    if (argc > 6 && strcmp("-v", argv[6]) == 0) {
-        experiment_configuration::verbose = true;
-    }
+    experiment_configuration::verbose = verbose;
 
     std::cout << "Loading completed!" << std::endl;
+    memory::report(std::cout);
 
     std::string command;
     while (in) {
@@ -57,7 +90,9 @@ int main(int argc, char** argv) {
         if (command.empty()) continue;
         if (command == "exit") break;
 
-        experiment_configuration configuration(train_dataset, *test_dataset, *validate_dataset, output_file);
+        experiment_configuration configuration = train_stream
+                                                 ? experiment_configuration(*train_stream, *test_dataset, *validate_dataset, output_file)
+                                                 : experiment_configuration(*train_dataset, *test_dataset, *validate_dataset, output_file);
         if (!configuration.from_string(command)) {
             std::cerr << "Command failed to parse:\n" << command << std::endl;
             continue;
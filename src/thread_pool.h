@@ -7,10 +7,21 @@
 
 #include "types.h"
 #include "cpu_config.h"
+#include "vectors.h"
+#include "spin_wait.h"
 #include <pthread.h>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <cassert>
-#include "barrier_t.h"
+
+// Submitted tasks which have not been run by every thread yet, a submission waits for a free place.
+#define THREAD_POOL_QUEUE 64u
 
 
 class thread_pool;
@@ -20,39 +31,102 @@ struct thread_data {
   uint id;
 };
 
-typedef void* tp_task_return_t;
-typedef void* tp_task_internal_args_t;
-
-typedef tp_task_return_t(* tp_task_t)(tp_task_internal_args_t, unsigned);
-
+// Runs every submitted task once on each of its threads, the tasks in the order of submission.
+// An idle thread waits for the submission counter as a wait_word: it spins first, so a sweep of short runs
+// dispatches without a syscall, and sleeps on a futex between the long ones.
 class thread_pool {
 private:
+  // A task with the number of threads still to run it. The last one completes it and deletes it.
+  struct job {
+    std::atomic<uint> remaining;
+
+    explicit job(uint threads) : remaining(threads) {}
+
+    virtual ~job() = default;
+
+    virtual void run(uint thread_id) = 0;
+
+    virtual void complete() = 0;
+  };
+
+  // The result of every thread goes to its own cache line, the promise gets them all at once.
+  template<typename F, typename R>
+  struct typed_job final : public job {
+    const F function;
+    vector<cache_padded<R>> results;
+    std::atomic<bool> failed;
+    std::exception_ptr error;
+    std::promise<std::vector<R>> promise;
+
+    typed_job(uint threads, F&& function) : job(threads), function(std::move(function)), failed(false) {
+        results.init(threads);
+    }
+
+    void run(const uint thread_id) override {
+        try {
+            results[thread_id].value = function(thread_id);
+        } catch (...) {
+            if (!failed.exchange(true)) error = std::current_exception();
+        }
+    }
+
+    void complete() override {
+        if (error) {
+            promise.set_exception(error);
+            return;
+        }
+        std::vector<R> values;
+        values.reserve(results.size);
+        FOR_N(i, results.size) {
+            values.push_back(std::move(results[i].value));
+        }
+        promise.set_value(std::move(values));
+    }
+  };
+
   const uint size;
   uint max_numa_node{};
   std::vector<pthread_t> threads;
   std::vector<thread_data> thread_datas;
-  std::vector<tp_task_return_t> results;
+  // Job number s sits in queue[s % THREAD_POOL_QUEUE] until every thread has run it.
+  std::vector<job*> queue;
+  std::mutex submit_mutex;
+  std::condition_variable space;
+  uint64_t submitted = 0;
+  uint64_t completed = 0;
+  std::atomic<uint64_t> published{};
   std::atomic<bool> stop{};
-  barrier_t ready;
-  barrier_t finished;
-
-  std::atomic<tp_task_t> task{};
-  std::atomic<tp_task_internal_args_t> args{};
+  // Changes with every submission and on stop.
+  cache_padded<wait_word> signal;
 
 
   void thread_loop(uint thread_id) {
       config.bind_to_cpu(thread_id);
+      uint64_t next = 0;
       while (true) {
-          barrier_wait(&ready);
-          if (stop.load()) break;
-          auto a_task = task.load();
-          auto the_args = args.load();
-          assert(a_task != nullptr);
-          results[thread_id] = a_task(the_args, thread_id);
-          barrier_wait(&finished);
+          const uint seen = signal.value.value.load(std::memory_order_acquire);
+          if (published.load(std::memory_order_acquire) > next) {
+              job* const current = queue[next % THREAD_POOL_QUEUE];
+              next++;
+              current->run(thread_id);
+              if (current->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) finish(current);
+              continue;
+          }
+          if (stop.load(std::memory_order_acquire)) break;
+          signal.value.wait(seen);
       }
   }
 
+  void finish(job* current) {
+      current->complete();
+      delete current;
+      {
+          std::lock_guard<std::mutex> lock(submit_mutex);
+          completed++;
+      }
+      space.notify_all();
+  }
+
   static void* thread_run(void* data) {
       auto* td = reinterpret_cast<thread_data*>(data);
 #ifdef __linux__
@@ -67,15 +141,13 @@ public:
   explicit thread_pool(uint size) : size(size) {
       threads.resize(size);
       thread_datas.resize(size);
-      results.resize(size);
+      queue.resize(THREAD_POOL_QUEUE, nullptr);
       FOR_N(i, size) {
           thread_datas[i].id = i;
           thread_datas[i].tp = this;
       }
 
       stop.store(false);
-      barrier_init(&ready, nullptr, size + 1);
-      barrier_init(&finished, nullptr, size + 1);
       max_numa_node = 0;
       FOR_N(i, size) {
           max_numa_node = std::max(max_numa_node, config.get_node_for_thread(i));
@@ -83,14 +155,17 @@ public:
       }
   }
 
+  // Runs the submitted tasks to the end.
   ~thread_pool() {
-      stop.store(true);
-      barrier_wait(&ready);
+      {
+          std::unique_lock<std::mutex> lock(submit_mutex);
+          space.wait(lock, [&]() { return completed == submitted; });
+          stop.store(true, std::memory_order_release);
+          signal.value.set(signal.value.value.load(std::memory_order_relaxed) + 1);
+      }
       FOR_N(i, size) {
           pthread_join(threads[i], nullptr);
       }
-      barrier_destroy(&ready);
-      barrier_destroy(&finished);
   }
 
   uint get_size() const {
@@ -101,14 +176,25 @@ public:
       return max_numa_node + 1;
   }
 
-  std::vector<tp_task_return_t> execute(tp_task_t hook, tp_task_internal_args_t hook_args) {
-      task.store(hook);
-      args.store(hook_args);
-      barrier_wait(&ready);
-      barrier_wait(&finished);
-      task.store(NULL);
-      args.store(NULL);
-      return results;
+  // Queues function(thread_id) for every thread and returns the future of their results in the order of the ids.
+  // Must not be called from the pool's own threads.
+  template<typename F>
+  std::future<std::vector<typename std::decay<decltype(std::declval<const F&>()(0u))>::type>> submit(F function) {
+      typedef typename std::decay<decltype(std::declval<const F&>()(0u))>::type R;
+      auto* current = new typed_job<F, R>(size, std::move(function));
+      auto result = current->promise.get_future();
+      std::unique_lock<std::mutex> lock(submit_mutex);
+      space.wait(lock, [&]() { return submitted - completed < THREAD_POOL_QUEUE; });
+      queue[submitted % THREAD_POOL_QUEUE] = current;
+      submitted++;
+      published.store(submitted, std::memory_order_release);
+      signal.value.set(signal.value.value.load(std::memory_order_relaxed) + 1);
+      return result;
+  }
+
+  template<typename F>
+  std::vector<typename std::decay<decltype(std::declval<const F&>()(0u))>::type> execute(F function) {
+      return submit(std::move(function)).get();
   }
 };
 
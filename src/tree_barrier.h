@@ -0,0 +1,147 @@
+//
+// Created by Maksim.Zuev on 17.10.2026.
+//
+
+#ifndef PSGD_TREE_BARRIER_H
+#define PSGD_TREE_BARRIER_H
+
+#include "types.h"
+#include "vectors.h"
+#include "cpu_config.h"
+#include "spin_wait.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+// Children of a node of the combining tree, e.g. -DBARRIER_FAN_IN=8.
+#ifndef BARRIER_FAN_IN
+#define BARRIER_FAN_IN 4
+#endif
+// Parent of the root of the tree.
+static const uint BARRIER_NO_PARENT = UINT_MAX;
+
+// Combining tree barrier laid out by the topology of cpu_config.
+// The leaves group at most BARRIER_FAN_IN threads of one node, siblings of a core next to each other,
+// the subtrees of a node join first and only their roots meet across the nodes.
+// The last thread to arrive at a tree node climbs to its parent, the rest wait for the node's release,
+// so the waiters poll a cache line shared with their neighbours only.
+// A waiter backs off exponentially and sleeps on a futex after the spin budget, see wait_word.
+class tree_barrier {
+public:
+  explicit tree_barrier(const uint threads, const uint64_t spin_budget = BARRIER_SPIN_BUDGET)
+      : spin_budget(spin_budget) {
+      build(threads);
+  }
+
+  // Every one of the threads passes its own id.
+  void wait(const uint thread_id) {
+      arrive(leaf_of[thread_id]);
+  }
+
+private:
+  struct barrier_node {
+    // Arrivals of the current round, the last one resets it.
+    std::atomic<uint> count;
+    uint expected;
+    uint parent;
+    char arrival_padding[64 - sizeof(std::atomic<uint>) - 2 * sizeof(uint)];
+    // Waiters leave once the generation changes.
+    wait_word generation;
+    char release_padding[64 - sizeof(wait_word)];
+
+    barrier_node() : count(0), expected(0), parent(BARRIER_NO_PARENT) {}
+  };
+
+  static_assert(sizeof(barrier_node) == 128, "Arrivals and releases of a tree node must take a cache line each.");
+
+  const uint64_t spin_budget;
+  vector<barrier_node> nodes;
+  std::vector<uint> leaf_of;
+
+  void arrive(const uint index) {
+      barrier_node& node = nodes[index];
+      // Cannot change before this thread arrives.
+      const uint generation = node.generation.value.load(std::memory_order_acquire);
+      if (node.count.fetch_add(1, std::memory_order_acq_rel) + 1 < node.expected) {
+          node.generation.wait(generation, spin_budget);
+          return;
+      }
+      node.count.store(0, std::memory_order_relaxed);
+      if (node.parent != BARRIER_NO_PARENT) arrive(node.parent);
+      node.generation.set(generation + 1);
+  }
+
+  // Groups `children` into as few tree nodes as the fan-in allows, evenly and keeping the order.
+  // Returns the tree node of every child.
+  static std::vector<uint> group(const uint children, std::vector<uint>& expected, std::vector<uint>& parents) {
+      const uint groups = (children + BARRIER_FAN_IN - 1) / BARRIER_FAN_IN;
+      const uint first = static_cast<uint>(expected.size());
+      expected.resize(first + groups, 0);
+      parents.resize(first + groups, BARRIER_NO_PARENT);
+      std::vector<uint> result(children);
+      FOR_N(i, children) {
+          result[i] = first + static_cast<uint>(static_cast<uint64_t>(i) * groups / children);
+          expected[result[i]]++;
+      }
+      return result;
+  }
+
+  // Joins the tree nodes [first, first + count) under a single root and returns it.
+  static uint join(uint first, uint count, std::vector<uint>& expected, std::vector<uint>& parents) {
+      while (count > 1) {
+          const std::vector<uint> parent = group(count, expected, parents);
+          FOR_N(i, count) {
+              parents[first + i] = parent[i];
+          }
+          first = parent[0];
+          count = parent.back() - first + 1;
+      }
+      return first;
+  }
+
+  void build(const uint threads) {
+      const uint phy_cpus = std::max(1u, config.get_phy_cpus());
+      std::vector<std::vector<uint>> node_threads;
+      std::vector<uint> order(threads);
+      std::iota(order.begin(), order.end(), 0);
+      // assign_thread_affinity places thread t on the core t % phy_cpus, its siblings follow phy_cpus apart.
+      std::stable_sort(order.begin(), order.end(), [&](uint a, uint b) {
+        return a % phy_cpus < b % phy_cpus;
+      });
+      for (const uint t: order) {
+          const uint node = config.get_node_for_thread(t);
+          if (node >= node_threads.size()) node_threads.resize(node + 1);
+          node_threads[node].push_back(t);
+      }
+
+      std::vector<uint> expected, parents, roots;
+      leaf_of.assign(threads, 0);
+      for (const std::vector<uint>& members: node_threads) {
+          if (members.empty()) continue;
+          const std::vector<uint> leaves = group(static_cast<uint>(members.size()), expected, parents);
+          FOR_N(i, members.size()) {
+              leaf_of[members[i]] = leaves[i];
+          }
+          roots.push_back(join(leaves[0], leaves.back() - leaves[0] + 1, expected, parents));
+      }
+      // The roots of the nodes meet in a tree of their own.
+      if (roots.size() > 1) {
+          const std::vector<uint> top = group(static_cast<uint>(roots.size()), expected, parents);
+          FOR_N(i, roots.size()) {
+              parents[roots[i]] = top[i];
+          }
+          join(top[0], top.back() - top[0] + 1, expected, parents);
+      }
+
+      nodes.init(static_cast<uint>(expected.size()));
+      FOR_N(i, expected.size()) {
+          nodes[i].expected = expected[i];
+          nodes[i].parent = parents[i];
+      }
+  }
+};
+
+#endif //PSGD_TREE_BARRIER_H
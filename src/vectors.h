@@ -6,8 +6,10 @@
 #define PSGD_VECTOR_H
 
 #include "types.h"
+#include "memory.h"
 #include <cassert>
 #include <algorithm>
+#include <new>
 
 template<typename T>
 class vector {
@@ -22,10 +24,14 @@ public:
       std::copy(other.data, other.data + size, data);
   }
 
+  // The elements live in memory::allocate, large vectors get huge pages.
   void init(uint _size) {
       size = _size;
       assert(data == NULL);
-      data = new T[size];
+      data = reinterpret_cast<T*>(memory::allocate(static_cast<size_t>(size) * sizeof(T)));
+      FOR_N(i, size) {
+          new(data + i) T;
+      }
   }
 
   void init(uint _size, const T& value) {
@@ -43,10 +49,45 @@ public:
 
   ~vector() {
       if (data != NULL) {
-          delete[] data;
+          FOR_N(i, size) {
+              data[i].~T();
+          }
+          memory::release(data, static_cast<size_t>(size) * sizeof(T));
       }
   }
 };
 
+// Base of the types which must start at a cache line. Plain new ignores alignas before C++17,
+// memory::allocate aligns to memory::ALIGNMENT.
+struct cache_aligned {
+  static void* operator new(size_t bytes) {
+      return memory::allocate(bytes);
+  }
+
+  static void operator delete(void* data, size_t bytes) {
+      memory::release(data, bytes);
+  }
+
+  static void* operator new[](size_t bytes) {
+      return memory::allocate(bytes);
+  }
+
+  static void operator delete[](void* data, size_t bytes) {
+      memory::release(data, bytes);
+  }
+
+  // The class operators hide the placement new which vector::init uses.
+  static void* operator new(size_t, void* place) {
+      return place;
+  }
+
+  static void operator delete(void*, void*) {}
+};
+
+// A value shared by the threads or one of an array of per-thread values, alone in its cache line.
+template<typename T>
+struct alignas(64) cache_padded : public cache_aligned {
+  T value;
+};
 
 #endif //PSGD_VECTOR_H